@@ -0,0 +1,44 @@
+#ifndef ANNOTATOR_H
+#define ANNOTATOR_H
+
+#include "LabelWriter.h"
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Matrix>
+#include <osg/BoundingBox>
+#include <osg/PositionAttitudeTransform>
+
+#include <string>
+#include <vector>
+
+/**
+    Computes 2D annotations of model objects analytically, without rendering: vertices of convex hull
+    of model are projected by transformation of object and camera matrices to output image pixels.
+    Hull of object crossing camera plane is clipped, so its box reaches image borders.
+    Every object gets tight bounding box clipped to image, visibility and truncation flags,
+    and optionally keypoints, projected corners of model bounding box. Occlusion between objects
+    is not taken into account.
+*/
+class Annotator : public osg::Referenced
+{
+    public:
+        //count of keypoints of object, corners of model bounding box
+        static const int KEYPOINTS = 8;
+
+        Annotator(osg::Node* model, bool _keypoints);
+
+        void annotate(const std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms,
+                const osg::Matrixd &viewProjection, double width, double height, LabelWriter &labels);
+        static void addColumns(std::vector<std::string> &columns, int objects, bool keypoints);
+    protected:
+        virtual ~Annotator();
+    private:
+        //vertices of convex hull of model in model coordinates
+        std::vector<osg::Vec3> hull;
+        osg::BoundingBox box;
+        bool keypoints;
+};
+
+#endif // ANNOTATOR_H
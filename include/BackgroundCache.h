@@ -0,0 +1,73 @@
+#ifndef BACKGROUNDCACHE_H
+#define BACKGROUNDCACHE_H
+
+#include <Configurator.h>
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Image>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <deque>
+
+/**
+    Bounded memory provider of background images.
+    Keeps LRU cache of decoded and scaled images, a prefetch thread decodes images
+    following the requested index, so sequential access does not wait for decoding.
+*/
+class BackgroundCache : public osg::Referenced
+{
+    public:
+        BackgroundCache(Configurator& cfg, int _capacity, int _prefetchCount);
+        virtual ~BackgroundCache();
+
+        int size() const { return files.size(); }
+        osg::ref_ptr<osg::Image> get(int index);
+    protected:
+        /**
+            Inner class, prefetch thread decodes queued indices until cache is stopped.
+        */
+        class Prefetcher : public OpenThreads::Thread {
+            public:
+                Prefetcher(BackgroundCache* _cache): cache(_cache) {}
+                virtual void run();
+            private:
+                BackgroundCache* cache;
+        };
+
+        struct Entry {
+            osg::ref_ptr<osg::Image> image;
+            std::list<int>::iterator lruPos;
+        };
+
+        osg::ref_ptr<osg::Image> load(int index);
+        void insert(int index, osg::Image* image);
+        void schedulePrefetch(int index);
+        bool popPrefetch(int &index);
+        void prefetched(int index, osg::Image* image);
+    private:
+        Configurator& config;
+        std::vector<std::string> files;
+        int capacity;
+        int prefetchCount;
+        //most recently used index first
+        std::list<int> lru;
+        std::map<int, Entry> entries;
+        std::deque<int> prefetchQueue;
+        //indices queued or being decoded by prefetch thread
+        std::set<int> pending;
+        bool done;
+        Prefetcher* prefetcher;
+        OpenThreads::Mutex cacheMutex;
+        OpenThreads::Condition prefetchRequested;
+        OpenThreads::Condition imageLoaded;
+};
+
+#endif // BACKGROUNDCACHE_H
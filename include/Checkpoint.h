@@ -0,0 +1,51 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <osg/Referenced>
+#include <osg/Timer>
+#include "LabelWriter.h"
+
+#include <stdio.h>
+#include <string>
+
+/**
+    Progress of a range of images generated in increasing order of image index.
+    Label rows are streamed to labels fragment of current folder, on commit fragment is flushed,
+    then manifest line 'index size binarySize fragment' is appended: all images of range up to index
+    are saved, and text and binary fragments are valid up to size and binarySize bytes. Files are synced,
+    so after a crash generation is resumed after last committed index, rows written after it are truncated.
+*/
+class Checkpoint : public osg::Referenced
+{
+    public:
+        Checkpoint(const std::string &_manifestFile, bool resume, double _interval);
+
+        bool isDone(int index) const { return index <= lastDone; }
+        void setFragment(const std::string &fileName, const std::string &binaryFileName);
+        LabelWriter &getLabels() { return labels; }
+        bool isDue() const;
+        bool commit(int index);
+    protected:
+        virtual ~Checkpoint();
+
+        bool readManifest();
+        FILE* openFragment(const std::string &fileName, bool committed, long size);
+    private:
+        std::string manifestFile;
+        //seconds between commits
+        double interval;
+        osg::Timer_t lastCommit;
+        //last committed index of range, and fragment and its size at that moment
+        int lastDone;
+        std::string doneFragment;
+        long doneSize;
+        long doneBinarySize;
+        std::string fragmentFile;
+        std::string binaryFragmentFile;
+        FILE* fragment;
+        FILE* binaryFragment;
+        FILE* manifest;
+        LabelWriter labels;
+};
+
+#endif // CHECKPOINT_H
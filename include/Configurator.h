@@ -29,6 +29,45 @@ struct Output {
     int numObjects;
     //min and max shifts between objects
     Bounds objShifts;
+    //render into offscreen pbuffer instead of a window
+    bool headless;
+    //count of pixel buffer objects used for asynchronous readback, 0 - synchronous
+    int pboCount;
+    //count of image writer threads, 0 - images saved in draw thread
+    int writerThreads;
+    //max count of images waiting for writer threads
+    int writerQueueSize;
+    //masks derived from object ID render target of the same frame instead of separate mask frames
+    bool idMasks;
+    //render size is output size multiplied by supersample factor, 0 - render width 800 pixels
+    int supersample;
+    int renderWidth;
+    int renderHeight;
+    //num_objects copies of model drawn by instanced draw calls instead of separate transformations
+    bool instancing;
+    //count of graphics contexts rendering concurrently in worker threads
+    int renderContexts;
+    //seconds between commits of generated images and labels to manifest
+    double checkpointInterval;
+    //labels are also written as table of fixed width binary records, 'labels.npy'
+    bool binaryLabels;
+    //2D boxes, visibility and truncation flags of objects are appended to labels
+    bool annotations;
+    //projected corners of model bounding box are appended to annotations
+    bool keypoints;
+    //format of masks: image, png or rle
+    std::string maskFormat;
+    //images, masks and label rows are packed into tar shards of shard_size_mb megabytes
+    bool packedShards;
+    int shardSizeMb;
+    //images and label rows are published to shared memory ring instead of files, if name is not empty
+    std::string streamName;
+    int streamSlots;
+    int streamSlotMb;
+    //max seconds producer waits for a free slot before record is dropped
+    double streamTimeout;
+    //images are published encoded by output extension instead of raw pixels
+    bool streamEncoded;
 };
 
 struct Translation {
@@ -63,12 +102,16 @@ class Configurator {
         std::vector<std::string> getBackgroundFiles() {return bg_files;}
         std::vector<std::string> getModelFiles() {return model_files;}
         const std::vector<Translation> &getTranslations() const {return translations;}
-        std::vector<osg::Image*> loadBackground();
+        osg::Image* loadBackgroundImage(const std::string &filename);
         osg::Image* loadMaskBackground();
         std::map<std::string, osg::Node*> loadModels();
         Output getOutput() {return output;}
         std::string getAsString() {return jsonString;}
         bool bgAugmentation() {return doBgAugmentation;}
+        bool gpuBgAugmentation() {return doGpuBgAugmentation;}
+        int bgCacheSize() {return bgCache;}
+        int bgPrefetchCount() {return bgPrefetch;}
+        unsigned long long randomSeed() {return seed;}
     protected:
         bool hasExtension(const std::string &fileName, const std::string &ext);
     private:
@@ -79,6 +122,22 @@ class Configurator {
         std::vector<Translation> translations;
         std::string jsonString;
         bool doBgAugmentation;
+        //augment background by texture matrix instead of resampling image
+        bool doGpuBgAugmentation;
+        //max count of decoded background images kept in memory
+        int bgCache;
+        //count of background images decoded ahead of the render loop
+        int bgPrefetch;
+        //count of model loading threads, 0 - count of processors
+        int loadThreads;
+        //seed of random generator, current time if not configured
+        unsigned long long seed;
+        //folder of binary model cache, empty - cache disabled
+        std::string modelCacheFolder;
+        //optimization of loaded models
+        bool optimizeModels;
+        //max count of triangles of optimized model, 0 - no simplification
+        int targetTriangles;
 };
 
 #endif // CONFIGURATOR_H
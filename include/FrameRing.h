@@ -0,0 +1,98 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <osg/Referenced>
+#include <osg/Image>
+#include <OpenThreads/Mutex>
+
+#include <stdint.h>
+#include <string>
+
+/**
+    Ring buffer of records in POSIX shared memory, rendered frames and label rows are published
+    to a consumer process on the same host, which reads them in place. One producer writes the ring,
+    one consumer reads it; producer waits while all slots are unread, at most wait timeout. If no slot
+    is freed in time, e.g. consumer is not started or has died, record is dropped with a warning, and
+    following records are dropped without waiting until consumer frees a slot. The ring is created
+    by producer, consumer unlinks it by shm_unlink when it is not needed anymore.
+
+    Layout, all numbers little endian:
+    ring header, 64 bytes:
+        0   char[8]   magic "IMGRING" terminated by zero
+        8   uint32    version, 1
+        12  uint32    slotCount
+        16  uint64    slotSize, bytes of slot including slot header
+        24  uint64    writeCount, records published, stored by producer after record is complete
+        32  uint64    readCount, records consumed, stored by consumer after record is processed
+        40  uint32    closed, 1 when producer has finished
+    slot of record n starts at 64 + (n % slotCount) * slotSize, slot header, 64 bytes:
+        0   uint64    sequence, n
+        8   uint32    kind, 0 - image, 1 - labels row
+        12  uint32    format, 0 - raw pixels, 1 - encoded file, 2 - text
+        16  uint32    width, 20 uint32 height, 24 uint32 channels of raw pixels
+        28  uint32    nameSize
+        32  uint64    dataSize
+    followed by name, file name of image (also for its labels row), and data at 8 byte aligned offset
+    64 + nameSize rounded up to 8. Raw pixels are 8-bit, rows from top to bottom without padding.
+    Consumer reads record n when n < writeCount (loaded with acquire), then stores readCount n + 1.
+*/
+class FrameRing : public osg::Referenced
+{
+    public:
+        enum Kind { IMAGE, LABELS };
+        enum Format { RAW, ENCODED, TEXT };
+
+        FrameRing(const std::string &_name, int _slotCount, uint64_t _slotSize, double _waitTimeout);
+
+        bool isValid() const { return header != NULL; }
+        bool publishImage(const std::string &fileName, const osg::Image &image);
+        bool publish(int kind, int format, const std::string &fileName, const char* data, uint64_t size);
+    protected:
+        virtual ~FrameRing();
+
+        /**
+            Ring header in shared memory.
+        */
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t slotCount;
+            uint64_t slotSize;
+            uint64_t writeCount;
+            uint64_t readCount;
+            uint32_t closed;
+            char reserved[20];
+        };
+
+        /**
+            Slot header in shared memory.
+        */
+        struct Slot {
+            uint64_t sequence;
+            uint32_t kind;
+            uint32_t format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t channels;
+            uint32_t nameSize;
+            uint64_t dataSize;
+            char reserved[24];
+        };
+
+        char* beginRecord(int kind, int format, const std::string &fileName, uint64_t size,
+                int width, int height, int channels);
+        void endRecord();
+    private:
+        std::string name;
+        size_t mappedSize;
+        //max seconds to wait for a free slot
+        double waitTimeout;
+        //ring was full after timeout, records are dropped until consumer frees a slot
+        bool stalled;
+        uint64_t droppedCount;
+        Header* header;
+        //producer can be called by several writer threads
+        OpenThreads::Mutex mutex;
+};
+
+#endif // FRAMERING_H
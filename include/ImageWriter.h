@@ -0,0 +1,79 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Image>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include "ShardWriter.h"
+#include "FrameRing.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+
+/**
+    This class scales and saves rendered images to files.
+    Images are passed through bounded queue to a pool of writer threads, so encoding
+    does not block the draw thread. When the queue is full, write() waits for a free place.
+    Without writer threads images are saved synchronously in write().
+    With shard writer images are encoded in memory and packed into shards instead of separate files.
+    With frame ring images are published to shared memory, raw or encoded, and not saved at all.
+*/
+class ImageWriter : public osg::Referenced
+{
+    public:
+        ImageWriter(int _outputWidth, int numThreads, int _queueSize);
+        virtual ~ImageWriter();
+
+        void write(osg::Image* image, const std::string& fileName);
+        void flush();
+        void setShardWriter(ShardWriter* writer) { shardWriter = writer; }
+        ShardWriter* getShardWriter() { return shardWriter.get(); }
+        void setFrameRing(FrameRing* ring, bool encoded) { frameRing = ring; encodeFrames = encoded; }
+        FrameRing* getFrameRing() { return frameRing.get(); }
+    protected:
+        struct Job {
+            osg::ref_ptr<osg::Image> image;
+            std::string fileName;
+        };
+
+        /**
+            Inner class, writer thread takes jobs from queue until writer is stopped.
+        */
+        class Worker : public OpenThreads::Thread {
+            public:
+                Worker(ImageWriter* _writer): writer(_writer) {}
+                virtual void run();
+            private:
+                ImageWriter* writer;
+                osg::ref_ptr<osg::Image> scratch;
+        };
+
+        bool pop(Job& job);
+        void jobDone();
+        void saveImage(osg::Image* image, const std::string& fileName, osg::ref_ptr<osg::Image> &scratch);
+
+        //output image width
+        int outputWidth;
+        int queueSize;
+        //scaled image storage used when images are saved synchronously
+        osg::ref_ptr<osg::Image> scratchImage;
+        osg::ref_ptr<ShardWriter> shardWriter;
+        osg::ref_ptr<FrameRing> frameRing;
+        bool encodeFrames;
+    private:
+        std::vector<Worker*> workers;
+        std::deque<Job> queue;
+        //count of jobs taken from queue and not finished yet
+        int activeJobs;
+        bool done;
+        OpenThreads::Mutex queueMutex;
+        OpenThreads::Condition notEmpty;
+        OpenThreads::Condition notFull;
+        OpenThreads::Condition idle;
+};
+
+#endif // IMAGEWRITER_H
@@ -3,6 +3,11 @@
 
 #include <Configurator.h>
 #include "SaveImageCallback.h"
+#include "Resampler.h"
+#include "BackgroundCache.h"
+#include "RandomGenerator.h"
+#include "LabelWriter.h"
+#include "Annotator.h"
 
 #include <osgViewer/Viewer>
 #include <osg/Node>
@@ -10,13 +15,16 @@
 #include <osg/Texture>
 #include <osg/Texture2D>
 #include <osg/TextureRectangle>
+#include <osg/TexMat>
 #include <osg/Geometry>
 #include <osg/PositionAttitudeTransform>
+#include <osg/Program>
 #include <osg/DisplaySettings>
 #include <osg/Math>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osgGA/TrackballManipulator>
+#include <OpenThreads/Thread>
 
 /**
     The class contains set of methods to generate collection of images according to given configuration.
@@ -30,39 +38,96 @@ class ImgGenerator
         virtual ~ImgGenerator();
         int generateImages();
         int generateMultipleImages();
+        int mergeLabels(int shards);
         void setMode(int _mode) {mode = _mode;}
+        void setShard(int index, int count) {shardIndex = index; shardCount = count;}
+        void setResume(bool _resume) {resume = _resume;}
     protected:
+        /**
+            Inner class, worker thread renders images by its own generator and graphics context.
+        */
+        class RenderThread : public OpenThreads::Thread {
+            public:
+                RenderThread(ImgGenerator* _generator, const std::map<std::string, osg::Node*>* _models,
+                        BackgroundCache* _bgCache, osg::Image* _maskBgImage):
+                    result(0), generator(_generator), models(_models), bgCache(_bgCache), maskBgImage(_maskBgImage) {}
+                virtual ~RenderThread() { delete generator; }
+                virtual void run();
+
+                int result;
+            private:
+                ImgGenerator* generator;
+                const std::map<std::string, osg::Node*>* models;
+                BackgroundCache* bgCache;
+                osg::Image* maskBgImage;
+        };
+
+        int renderConcurrently(const std::map<std::string, osg::Node*> &models, BackgroundCache* bgCache,
+                osg::Image* maskBgImage, int contexts);
+        int renderImages(const std::map<std::string, osg::Node*> &models, BackgroundCache* bgCache,
+                osg::Image* maskBgImage, bool worker);
+        void releaseScene(osgViewer::Viewer &viewer, osg::TextureRectangle* textureRect,
+                std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms);
         osg::ref_ptr<osg::Camera> createBackgroundCamera();
+        osg::ref_ptr<SaveImageCallback> createSaveImageCallback();
         osg::ref_ptr<osg::TextureRectangle> createBackgroundTexture(osg::Camera* bg_cam, float s, float t);
         void generateImage(osg::Image* image, std::string fileName,
             osg::ref_ptr<osg::TextureRectangle> &textureRect, osgViewer::Viewer &viewer);
-        void setTranslation(osg::ref_ptr<osg::PositionAttitudeTransform> modelTf, Translation tr, int j,
-                std::string &labels, std::string fileShortName);
+        void waitImageSaved(SaveImageCallback* saveImageCallback);
+        void writePerformanceReport();
+        void flushImages(osgViewer::Viewer &viewer);
         void setTranslation(std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > transforms, Translation tr, int j,
-                std::string &labels, std::string fileShortName, int groupCount);
+                LabelWriter &labels, std::string fileShortName, int fileIndex, int groupCount);
+        void annotateImage(Annotator* annotator, osgViewer::Viewer &viewer,
+                std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms, LabelWriter &labels);
         int makeDir(std::string path, std::string name);
         int makeDir(std::string path);
         bool dirExists(std::string dir);
         void createInfo(std::string path, std::string content);
         void createLabels(std::string path, std::string content);
+        std::string labelsFragmentName(int index, int count, bool binary = false);
+        std::vector<std::string> labelColumns(bool binary);
+        int maskFormat();
+        std::string maskExtension();
+        bool mergeBinaryLabels(std::string path, int count);
+        bool isShardImage(int index, int total);
+        bool hasShardImages(int first, int count, int total);
+        void createEmptyFragment(std::string fileName);
 
         osg::Vec3d getPosition(Translation tr, int j);
         osg::Vec3d getRotation(Translation tr, int j);
         osg::Vec3d getScale(Translation tr, int j);
-        double getRand(double min, double max);
-        osg::Image* cropImage(const osg::Image* image,
-                      double src_minx, double src_miny, double src_maxx, double src_maxy,
-                      double &dst_minx, double &dst_miny, double &dst_maxx, double &dst_maxy);
+        double getRand(double min, double max, int stream);
+        osg::Image* augmentBackground(osg::Image* image);
+        void augmentBackgroundTexture(int width, int height);
 
         void setGroupShift(std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > transforms, osg::Vec3d position, int groupCount);
         void setGroupShift(osg::ref_ptr<osg::PositionAttitudeTransform> tr,
                 osg::ref_ptr<osg::PositionAttitudeTransform> tr2,
                 osg::Vec3d position, int signX, int signY, int signZ);
-        void initTraits(int bgWidth, int bgHeight, osgViewer::Viewer &viewer);
+        int initTraits(int bgWidth, int bgHeight, osgViewer::Viewer &viewer);
+        void setupObjectIdRendering(osgViewer::Viewer &viewer, osg::Camera* bg_cam,
+                SaveImageCallback* saveImageCallback, int width, int height);
+        void setObjectId(osg::PositionAttitudeTransform* tf, int id);
     private:
         Configurator config;
         //mode = 0 - view (default), mode = 1 - generate.
         int mode;
+        //this process generates shardIndex-th of shardCount contiguous ranges of image indices
+        int shardIndex;
+        int shardCount;
+        //skip images committed to manifest by previous run
+        bool resume;
+        //generator of random draws, keyed by seed and global image index
+        RandomGenerator randomGenerator;
+        //object ID rendering state, shared by all transformations
+        osg::ref_ptr<osg::Program> objectIdProgram;
+        osg::ref_ptr<osg::Texture2D> whiteTexture;
+        //augmented background and resampler buffers, reused between frames
+        osg::ref_ptr<osg::Image> bgScratch;
+        ResampleWorkspace resampleWorkspace;
+        //background quad texture matrix for GPU augmentation
+        osg::ref_ptr<osg::TexMat> bgTexMat;
 };
 
 #endif // IMGGENERATOR_H
@@ -0,0 +1,54 @@
+#ifndef INSTANCEDMODEL_H
+#define INSTANCEDMODEL_H
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Group>
+#include <osg/Geometry>
+#include <osg/Uniform>
+#include <osg/Texture2D>
+#include <osg/PositionAttitudeTransform>
+
+#include <vector>
+
+/**
+    Copy of a model drawn in several instances by one instanced draw call per primitive set.
+    Instances are placed by matrices of 'instanceMatrices' uniform array, set from transformations
+    which are not a part of scene graph. Bounding boxes of drawables include all instances,
+    so culling and near/far planes computation stay correct.
+*/
+class InstancedModel : public osg::Referenced
+{
+    public:
+        //max count of instances, limited by size of uniform array
+        static const int MAX_INSTANCES = 64;
+
+        InstancedModel(osg::Node* model, int _count, bool objectIds, osg::Texture2D* whiteTexture);
+
+        osg::Node* getNode() { return root.get(); }
+        void setInstanceMatrices(const std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms);
+    protected:
+        virtual ~InstancedModel();
+
+        /**
+            Inner class, bounding box of drawable is a union of its boxes transformed by instance matrices.
+        */
+        class BoundCallback : public osg::Drawable::ComputeBoundingBoxCallback {
+            public:
+                BoundCallback(const std::vector<osg::Matrix>* _matrices): matrices(_matrices) {}
+                virtual osg::BoundingBox computeBound(const osg::Drawable& drawable) const;
+            private:
+                const std::vector<osg::Matrix>* matrices;
+        };
+
+        void prepareGeometry(osg::Geometry* geometry);
+    private:
+        int count;
+        osg::ref_ptr<osg::Group> root;
+        osg::ref_ptr<osg::Uniform> matricesUniform;
+        //instance matrices, also read by bound callbacks
+        std::vector<osg::Matrix> matrices;
+        std::vector<osg::ref_ptr<osg::Geometry> > geometries;
+};
+
+#endif // INSTANCEDMODEL_H
@@ -0,0 +1,51 @@
+#ifndef LABELWRITER_H
+#define LABELWRITER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+    Buffered writer of label rows. Rows are formatted directly into fixed size buffers,
+    which are written to files when they are full, so memory does not grow with count of rows.
+    Text rows are CSV, numbers are formatted as shortest text which reads back to the same float value.
+    Binary rows are fixed width records of int32 file index and float32 columns in little endian order,
+    fragments of records are joined into .npy table. Without file rows are discarded.
+*/
+class LabelWriter
+{
+    public:
+        LabelWriter(size_t _chunkSize = 65536);
+        virtual ~LabelWriter();
+
+        void setFile(FILE* _file, FILE* _binaryFile = NULL);
+        void beginRow(const std::string &name, int index);
+        void addNumber(double value);
+        void addBinaryNumber(double value);
+        void addText(const std::string &text);
+        void endRow();
+        bool flush();
+        void setKeepLastRow(bool keep) { keepLastRow = keep; }
+        const std::string &getLastRow() const { return lastRow; }
+
+        static int formatNumber(char* buffer, int size, double value);
+        static std::string npyHeader(const std::vector<std::string> &columns, long rows);
+    private:
+        void reserve(size_t size);
+        void appendBinary(const void* data, size_t size);
+
+        FILE* file;
+        FILE* binaryFile;
+        size_t chunkSize;
+        std::vector<char> buffer;
+        size_t used;
+        //start of current row in buffer, rows are not split between writes
+        size_t rowStart;
+        bool keepLastRow;
+        std::string lastRow;
+        bool writeFailed;
+        std::vector<char> binaryBuffer;
+        size_t binaryUsed;
+};
+
+#endif // LABELWRITER_H
@@ -0,0 +1,42 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osgDB/Options>
+
+#include <string>
+
+/**
+    On-disk cache of loaded models in native binary .osgb format.
+    Every cached model has a sidecar key file with source path, modification time, size
+    and content hash, the cached model is used only if the key matches the source file.
+    Images and materials are embedded in cached model, so modification time and size of material
+    libraries and texture images of model are kept in key file too.
+*/
+class ModelCache : public osg::Referenced
+{
+    public:
+        ModelCache(const std::string &_folder, const std::string &_variant = "");
+
+        osg::Node* read(const std::string &fileName, std::string &key);
+        void write(const std::string &fileName, const std::string &key, osg::Node* node);
+    protected:
+        virtual ~ModelCache();
+
+        std::string computeKey(const std::string &fileName);
+        std::string cachePath(const std::string &fileName, const std::string &extension);
+        static std::string resolvePath(const std::string &fileName, const std::string &reference);
+        static std::string fileStamp(const std::string &path);
+        static unsigned long long hashBytes(const char* data, size_t size, unsigned long long hash);
+        static std::string toHex(unsigned long long value);
+    private:
+        std::string folder;
+        //settings of model processing after loading, appended to key
+        std::string variant;
+        //images are embedded in cached model, their files are checked by stamps in key file
+        osg::ref_ptr<osgDB::Options> writeOptions;
+};
+
+#endif // MODELCACHE_H
@@ -0,0 +1,60 @@
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#include <osg/Node>
+#include <osg/ref_ptr>
+#include <OpenThreads/Thread>
+#include "ModelCache.h"
+#include "ModelOptimizer.h"
+#include <OpenThreads/Mutex>
+
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+    Loads list of 3D model files concurrently on a pool of worker threads.
+    Each worker takes the next file from the list, so large files do not block the others.
+*/
+class ModelLoader
+{
+    public:
+        ModelLoader(const std::vector<std::string> &_files, int _threadCount, ModelCache* _cache = NULL,
+                ModelOptimizer* _optimizer = NULL);
+        virtual ~ModelLoader();
+
+        std::map<std::string, osg::Node*> load();
+    protected:
+        /**
+            Inner class, worker thread loads files until the list is exhausted.
+        */
+        class Worker : public OpenThreads::Thread {
+            public:
+                Worker(ModelLoader* _loader): loader(_loader) {}
+                virtual void run();
+            private:
+                ModelLoader* loader;
+        };
+
+        bool nextFile(int &index);
+        void loadFile(int index);
+    private:
+        std::vector<std::string> files;
+        int threadCount;
+        //cache of binary models, can be NULL
+        osg::ref_ptr<ModelCache> cache;
+        //optimizer of loaded models, can be NULL
+        osg::ref_ptr<ModelOptimizer> optimizer;
+        //loaded models and load times in seconds, in order of files
+        std::vector<osg::ref_ptr<osg::Node> > nodes;
+        std::vector<double> loadTimes;
+        //char instead of bool, vector<bool> elements can not be written by different threads
+        std::vector<char> cached;
+        //statistics of models before and after optimization
+        std::vector<GeometryStats> statsBefore;
+        std::vector<GeometryStats> statsAfter;
+        int nextIndex;
+        OpenThreads::Mutex indexMutex;
+};
+
+#endif // MODELLOADER_H
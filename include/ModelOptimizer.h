@@ -0,0 +1,43 @@
+#ifndef MODELOPTIMIZER_H
+#define MODELOPTIMIZER_H
+
+#include <osg/Referenced>
+#include <osg/Node>
+
+#include <string>
+
+/**
+    Counts of draw calls (primitive sets) and triangles of a model.
+*/
+struct GeometryStats {
+    unsigned int drawCalls;
+    unsigned int triangles;
+
+    GeometryStats(): drawCalls(0), triangles(0) {}
+};
+
+/**
+    Optimization pass applied to loaded models before rendering.
+    Removes redundant nodes and static transforms, shares duplicate state, merges geometries,
+    optionally simplifies model to a target count of triangles, then converts geometries into
+    indexed triangles ordered for vertex cache and drawn from vertex buffer objects.
+    Models are not shared between threads, so different models can be optimized concurrently.
+*/
+class ModelOptimizer : public osg::Referenced
+{
+    public:
+        ModelOptimizer(int _targetTriangles);
+
+        void optimize(osg::Node* node, GeometryStats &before, GeometryStats &after);
+        std::string getSignature() const;
+        static GeometryStats computeStats(osg::Node* node);
+    protected:
+        virtual ~ModelOptimizer();
+
+        void simplify(osg::Node* node, unsigned int triangles);
+    private:
+        //max count of triangles of optimized model, 0 - no simplification
+        int targetTriangles;
+};
+
+#endif // MODELOPTIMIZER_H
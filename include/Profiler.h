@@ -0,0 +1,53 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+
+/**
+    Collects durations of generation stages measured by monotonic clock into per-stage histograms.
+    Histogram buckets are logarithmic, 8 per power of two, so percentiles are accurate to about 6%.
+    Samples are recorded by atomic increments, stages can be measured by any thread.
+*/
+class Profiler
+{
+    public:
+        enum Stage { BACKGROUND_DECODE, MODEL_LOAD, SET_TRANSLATION, FRAME, READBACK, SCALE, ENCODE, WRITE, WAIT,
+            STAGE_COUNT };
+
+        static Profiler* instance();
+        static uint64_t now();
+        static const char* stageName(int stage);
+
+        void record(int stage, uint64_t duration);
+        double percentile(int stage, double p) const;
+        void print(std::ostream &out) const;
+        bool writeJson(const std::string &fileName) const;
+    protected:
+        Profiler();
+
+        static int bucket(uint64_t duration);
+        static double bucketValue(int index);
+    private:
+        static const int BUCKETS = 64 * 8;
+        uint64_t counts[STAGE_COUNT][BUCKETS];
+        uint64_t samples[STAGE_COUNT];
+        uint64_t totals[STAGE_COUNT];
+        uint64_t maxima[STAGE_COUNT];
+};
+
+/**
+    Measures duration of a stage from construction to destruction.
+*/
+class StageTimer
+{
+    public:
+        StageTimer(int _stage): stage(_stage), start(Profiler::now()) {}
+        ~StageTimer() { Profiler::instance()->record(stage, Profiler::now() - start); }
+    private:
+        int stage;
+        uint64_t start;
+};
+
+#endif // PROFILER_H
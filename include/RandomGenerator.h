@@ -0,0 +1,40 @@
+#ifndef RANDOMGENERATOR_H
+#define RANDOMGENERATOR_H
+
+/**
+    Counter-based pseudo-random generator. Every value is a hash of (seed, image index, stream, counter),
+    so values drawn for an image do not depend on images generated before it, and any image
+    can be regenerated alone, by other thread or process, with the same result.
+    Streams separate independent groups of draws, e.g. background augmentation does not shift
+    object poses when it is switched on.
+*/
+class RandomGenerator
+{
+    public:
+        //streams of draws made for an image
+        enum Stream {
+            POSE_STREAM = 0,
+            GROUP_STREAM,
+            VISIBILITY_STREAM,
+            BACKGROUND_STREAM,
+            STREAM_COUNT
+        };
+
+        RandomGenerator(unsigned long long _seed = 0);
+
+        void setSeed(unsigned long long _seed) { seed = _seed; }
+        unsigned long long getSeed() const { return seed; }
+        void setImage(long long index);
+        double uniform(int stream);
+        double uniform(double from, double to, int stream);
+        int uniformInt(int min, int max, int stream);
+
+        static unsigned long long mix(unsigned long long value);
+    private:
+        unsigned long long seed;
+        long long image;
+        //count of values drawn from each stream for current image
+        unsigned int counters[STREAM_COUNT];
+};
+
+#endif // RANDOMGENERATOR_H
@@ -0,0 +1,58 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <osg/Image>
+
+#include <vector>
+
+/**
+    Resampling of 8-bit images with interleaved channels, used instead of osg::Image::scaleImage.
+    Source and destination buffers are supplied by caller, rows are addressed with stride in bytes.
+    Row passes use AVX2 or SSE2 when supported by CPU, otherwise scalar code with the same integer arithmetic,
+    so all paths produce identical results.
+*/
+
+//row kernels of resampling functions
+enum ResampleKernel { RESAMPLE_AUTO, RESAMPLE_SCALAR, RESAMPLE_SSE2, RESAMPLE_AVX2 };
+
+//Forces row kernels of specified instruction set, returns false if not supported by CPU.
+bool setResampleKernel(int kernel);
+
+/**
+    Temporary buffers of resampling functions. Workspace reused between calls keeps
+    its capacity, so repeated resampling to the same size does not allocate memory.
+*/
+struct ResampleWorkspace {
+    std::vector<unsigned short> row;
+    std::vector<unsigned char> box;
+    std::vector<int> x0, x1, wx, y0, y1, wy;
+};
+
+/**
+    Downsamples image by integer factor, each destination pixel is an average of factor x factor source pixels.
+    Destination size is (srcWidth / factor) x (srcHeight / factor).
+*/
+void downsampleBox(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int channels,
+        int factor, unsigned char* dst, int dstStride, ResampleWorkspace* workspace = NULL);
+
+//Resizes image to arbitrary size with bilinear filter.
+void resizeBilinear(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int channels,
+        unsigned char* dst, int dstWidth, int dstHeight, int dstStride, ResampleWorkspace* workspace = NULL);
+
+//Resizes image, box filter for integer factors, box pre-pass and bilinear filter otherwise.
+void resizeImage(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int channels,
+        unsigned char* dst, int dstWidth, int dstHeight, int dstStride, ResampleWorkspace* workspace = NULL);
+
+//Mirrors image rows in place.
+void flipHorizontal(unsigned char* data, int width, int height, int stride, int channels);
+
+//Reverses order of image rows in place.
+void flipVertical(unsigned char* data, int width, int height, int stride, int channels);
+
+//Resamples 8-bit src image into preallocated dst image of the same pixel format, returns false if not supported.
+bool resampleImage(const osg::Image& src, osg::Image& dst, ResampleWorkspace* workspace = NULL);
+
+//Scales 8-bit image in place, falls back to osg::Image::scaleImage for other data types.
+void scaleImage(osg::Image& image, int width, int height);
+
+#endif // RESAMPLER_H
@@ -2,27 +2,87 @@
 #define SAVEIMAGECALLBACK_H
 
 #include <osg/Camera>
+#include <osg/Image>
+#include <osg/GLExtensions>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include "ImageWriter.h"
 
+#include <vector>
 
+/**
+    Final draw callback, reads back rendered frame and passes it to ImageWriter to be saved to a file.
+    When a ring of pixel buffer objects is enabled, frame N is read asynchronously into a PBO
+    and saved while frame N+1 is rendered; an extra frame with empty file name flushes the ring.
+*/
 class SaveImageCallback : public osg::Camera::DrawCallback
 {
     public:
+        //mask files as images of output format, single-channel images, or run-length encoded masks kept in memory
+        enum MaskFormat { MASK_IMAGE, MASK_GRAY, MASK_RLE };
+        //object IDs of mask request are bits of unsigned int
+        static const int MAX_MASK_OBJECTS = 31;
+
         SaveImageCallback(int _outputWidth);
         virtual ~SaveImageCallback();
 
         void setFileName(const std::string& aFileName) { fileName = aFileName; }
+        //count of pixel buffer objects in readback ring, values less than 2 disable asynchronous readback
+        void setPboCount(int count) { pboCount = count; }
+        bool isAsync() { return pboCount > 1; }
+        void setImageWriter(ImageWriter* writer) { imageWriter = writer; }
+        ImageWriter* getImageWriter() { return imageWriter.get(); }
+        void setObjectIdImages(osg::Image* color, osg::Image* ids) { colorImage = color; idImage = ids; }
+        void setMaskBackground(osg::Image* image) { maskBackground = image; }
+        void setMaskFormat(int format) { maskFormat = format; }
+        void addMaskRequest(const std::string& maskFileName, unsigned int objectBits);
+        std::vector<std::string> takeEncodedMasks();
 
+        virtual void operator () (osg::RenderInfo& renderInfo) const;
         virtual void operator () (const osg::Camera& camera) const;
-        bool isFinished() { return finished; }
-        void setFinished(bool _finished) { finished = _finished;}
+        bool isFinished();
+        void setFinished(bool _finished);
+        bool waitFinished(unsigned long timeoutMs);
     protected:
+        void readPixelsAsync(osg::RenderInfo& renderInfo) const;
+        void mapPixelBuffer(osg::GLExtensions* ext, int slot) const;
+        void saveImage(osg::Image* image, const std::string& name) const;
+        void signalFinished() const;
+        void saveObjectIdFrame() const;
+        osg::Image* createMask(unsigned int objectBits) const;
+        osg::Image* createGrayMask(unsigned int objectBits) const;
+        std::string encodeMask(unsigned int objectBits) const;
+
+        //mask file and bit set of 1-based object IDs (bit 0 - ID 1) painted in it
+        struct MaskRequest {
+            std::string fileName;
+            unsigned int objectBits;
+        };
+
         std::string _prefix;
         std::string _fileId;
         std::string fileName;
         //output image width and height
         int outputWidth;
+        int pboCount;
+        int maskFormat;
+        osg::ref_ptr<ImageWriter> imageWriter;
+        osg::ref_ptr<osg::Image> colorImage;
+        osg::ref_ptr<osg::Image> idImage;
+        osg::ref_ptr<osg::Image> maskBackground;
     private:
         bool mutable finished;
+        mutable OpenThreads::Mutex finishedMutex;
+        mutable OpenThreads::Condition finishedCondition;
+        //pixel buffer objects ring and file names of frames pending in it
+        mutable std::vector<GLuint> pbos;
+        mutable std::vector<std::string> pendingNames;
+        mutable int currentPbo;
+        mutable int pboWidth;
+        mutable int pboHeight;
+        mutable std::vector<MaskRequest> maskRequests;
+        //run-length encoded masks of last frame, in order of requests
+        mutable std::vector<std::string> encodedMasks;
 };
 
 #endif // SAVEIMAGECALLBACK_H
@@ -0,0 +1,29 @@
+#ifndef SHADERS_H
+#define SHADERS_H
+
+#include <osg/Program>
+#include <osg/Texture2D>
+
+/**
+    GLSL programs used when colour and object ID are rendered in one pass into
+    multiple render targets: colour goes to gl_FragData[0], object ID to red channel of gl_FragData[1],
+    and by instanced rendering of models.
+*/
+
+//Creates program for models, fixed function like lighting of light 0, texture unit 0 and 'objectId' uniform.
+osg::Program* createObjectIdProgram();
+
+//Creates program for models drawn in 'instanceCount' instances, transformed by 'instanceMatrices' uniform array.
+//With object IDs, 1-based instance index is written as object ID.
+osg::Program* createInstancedProgram(int instanceCount, bool objectIds);
+
+//Creates program for background quad, samples rectangle texture and writes zero object ID.
+osg::Program* createBackgroundIdProgram();
+
+//Creates 1x1 white texture, bound to unit 0 so untextured models can use same program.
+osg::Texture2D* createWhiteTexture();
+
+//Converts 1-based object index into value of 'objectId' uniform.
+float objectIdToUniform(int id);
+
+#endif // SHADERS_H
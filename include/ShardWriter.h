@@ -0,0 +1,46 @@
+#ifndef SHARDWRITER_H
+#define SHARDWRITER_H
+
+#include <osg/Referenced>
+#include <OpenThreads/Mutex>
+
+#include <stdio.h>
+#include <string>
+
+/**
+    Packs encoded images, masks and label rows into large tar shards instead of one file per image.
+    Shards 'prefix-NNNNNN.tar' are plain ustar archives, a new shard is started when current one
+    exceeds shard size. Every member gets line 'name shard offset size' in 'prefix.idx', where offset
+    is position of member data in shard, so members can be read without unpacking.
+    On resume new shards are started after existing ones and index is continued, later lines of
+    the same name replace earlier ones. Members can be appended by several threads.
+*/
+class ShardWriter : public osg::Referenced
+{
+    public:
+        ShardWriter(const std::string &_prefix, const std::string &_root, long long _shardSize, bool _resume);
+
+        bool append(const std::string &fileName, const std::string &data);
+        bool flush();
+    protected:
+        virtual ~ShardWriter();
+
+        bool openShard();
+        void closeShard();
+        std::string shardName(int index);
+        std::string memberName(const std::string &fileName);
+    private:
+        std::string prefix;
+        //path prefix removed from member names
+        std::string root;
+        long long shardSize;
+        bool resume;
+        int shardIndex;
+        std::string shardFile;
+        FILE* shard;
+        long long shardBytes;
+        FILE* index;
+        OpenThreads::Mutex mutex;
+};
+
+#endif // SHARDWRITER_H
@@ -0,0 +1,341 @@
+#include "Annotator.h"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <osg/Transform>
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <set>
+#include <sstream>
+
+//distance of clip plane from camera relative to the farthest vertex of object
+static const double CLIP_DISTANCE = 1e-4;
+
+/**
+    Inner class, collects vertices of model geometries transformed to model coordinates.
+*/
+class VertexCollector : public osg::NodeVisitor {
+    public:
+        VertexCollector(std::vector<osg::Vec3> &_points):
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), points(_points) {}
+
+        virtual void apply(osg::Geode& geode) {
+            osg::Matrix m = osg::computeLocalToWorld(getNodePath());
+            for (unsigned int i = 0; i < geode.getNumDrawables(); i++) {
+                osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+                osg::Vec3Array* vertices = geometry ? dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray()) : NULL;
+                if (!vertices) {
+                    continue;
+                }
+                for (unsigned int j = 0; j < vertices->size(); j++) {
+                    points.push_back((*vertices)[j] * m);
+                }
+            }
+        }
+    private:
+        std::vector<osg::Vec3> &points;
+};
+
+//triangle of convex hull, vertices are counter-clockwise seen from outside
+struct HullFace {
+    int a, b, c;
+    osg::Vec3d normal;
+    double offset;
+    //points outside of hull which are in front of face
+    std::vector<int> outside;
+};
+
+//Creates face of points with specified indices.
+static HullFace createFace(const std::vector<osg::Vec3> &points, int a, int b, int c) {
+    HullFace face;
+    face.a = a;
+    face.b = b;
+    face.c = c;
+    osg::Vec3d pa = points[a];
+    face.normal = (osg::Vec3d(points[b]) - pa) ^ (osg::Vec3d(points[c]) - pa);
+    face.normal.normalize();
+    face.offset = face.normal * pa;
+    return face;
+}
+
+//Assigns point to outside set of the first face it is in front of, returns false if point is behind all faces.
+static bool assignPoint(const std::vector<osg::Vec3> &points, std::vector<HullFace> &faces, int first, int point,
+        double eps) {
+    for (int f = first; f < faces.size(); f++) {
+        if (faces[f].normal * osg::Vec3d(points[point]) - faces[f].offset > eps) {
+            faces[f].outside.push_back(point);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+    Finds vertices of convex hull of points by quickhull algorithm: the farthest outside point of a face
+    replaces faces visible from it by a cone of faces from the point to their horizon edges, outside points
+    of replaced faces are assigned to new faces or dropped if they are inside of hull.
+    @param points the distinct points.
+    @return indices of hull vertices, or all indices if points are coplanar
+*/
+static std::vector<int> convexHull(const std::vector<osg::Vec3> &points) {
+    std::vector<int> all;
+    for (int i = 0; i < points.size(); i++) {
+        all.push_back(i);
+    }
+    if (points.size() < 4) {
+        return all;
+    }
+    osg::BoundingBox bounds;
+    for (int i = 0; i < points.size(); i++) {
+        bounds.expandBy(points[i]);
+    }
+    double eps = 1e-6 * bounds.radius();
+    //initial tetrahedron: extreme points in x, farthest point from their line and from their plane
+    int i0 = 0, i1 = 0;
+    for (int i = 1; i < points.size(); i++) {
+        i0 = points[i].x() < points[i0].x() ? i : i0;
+        i1 = points[i].x() > points[i1].x() ? i : i1;
+    }
+    osg::Vec3d dir = osg::Vec3d(points[i1]) - osg::Vec3d(points[i0]);
+    int i2 = -1, i3 = -1;
+    double best = eps;
+    for (int i = 0; i < points.size(); i++) {
+        double d = ((osg::Vec3d(points[i]) - osg::Vec3d(points[i0])) ^ dir).length() / osg::maximum(dir.length(), eps);
+        if (d > best) {
+            best = d;
+            i2 = i;
+        }
+    }
+    if (i2 < 0) {
+        return all;
+    }
+    HullFace base = createFace(points, i0, i1, i2);
+    best = eps;
+    for (int i = 0; i < points.size(); i++) {
+        double d = fabs(base.normal * osg::Vec3d(points[i]) - base.offset);
+        if (d > best) {
+            best = d;
+            i3 = i;
+        }
+    }
+    if (i3 < 0) {
+        return all;
+    }
+    if (base.normal * osg::Vec3d(points[i3]) - base.offset > 0) {
+        std::swap(i1, i2);
+    }
+    std::vector<HullFace> faces;
+    faces.push_back(createFace(points, i0, i1, i2));
+    faces.push_back(createFace(points, i0, i3, i1));
+    faces.push_back(createFace(points, i1, i3, i2));
+    faces.push_back(createFace(points, i2, i3, i0));
+    for (int i = 0; i < points.size(); i++) {
+        assignPoint(points, faces, 0, i, eps);
+    }
+
+    std::set<std::pair<int, int> > edges;
+    std::vector<int> orphans;
+    std::vector<HullFace> kept;
+    while (true) {
+        int f = 0;
+        while (f < faces.size() && faces[f].outside.empty()) {
+            f++;
+        }
+        if (f == faces.size()) {
+            break;
+        }
+        int eye = faces[f].outside[0];
+        best = -DBL_MAX;
+        for (int j = 0; j < faces[f].outside.size(); j++) {
+            int i = faces[f].outside[j];
+            double d = faces[f].normal * osg::Vec3d(points[i]) - faces[f].offset;
+            if (d > best) {
+                best = d;
+                eye = i;
+            }
+        }
+        osg::Vec3d p = points[eye];
+        edges.clear();
+        orphans.clear();
+        kept.clear();
+        for (int g = 0; g < faces.size(); g++) {
+            if (faces[g].normal * p - faces[g].offset > eps) {
+                edges.insert(std::make_pair(faces[g].a, faces[g].b));
+                edges.insert(std::make_pair(faces[g].b, faces[g].c));
+                edges.insert(std::make_pair(faces[g].c, faces[g].a));
+                orphans.insert(orphans.end(), faces[g].outside.begin(), faces[g].outside.end());
+            }
+            else {
+                kept.push_back(HullFace());
+                std::swap(kept.back(), faces[g]);
+            }
+        }
+        int first = kept.size();
+        //horizon edge is shared by visible and hidden face, reversed edge is not visible
+        for (std::set<std::pair<int, int> >::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+            if (edges.find(std::make_pair(it->second, it->first)) == edges.end()) {
+                kept.push_back(createFace(points, it->first, it->second, eye));
+            }
+        }
+        for (int j = 0; j < orphans.size(); j++) {
+            if (orphans[j] != eye) {
+                assignPoint(points, kept, first, orphans[j], eps);
+            }
+        }
+        faces.swap(kept);
+    }
+    std::vector<int> hull;
+    for (int f = 0; f < faces.size(); f++) {
+        hull.push_back(faces[f].a);
+        hull.push_back(faces[f].b);
+        hull.push_back(faces[f].c);
+    }
+    std::sort(hull.begin(), hull.end());
+    hull.erase(std::unique(hull.begin(), hull.end()), hull.end());
+    return hull;
+}
+
+/**
+    Constructor, collects vertices of model and keeps vertices of its convex hull,
+    projection of the hull has the same bounds as projection of the model.
+    @param model the loaded model.
+    @param _keypoints write projected corners of model bounding box.
+*/
+Annotator::Annotator(osg::Node* model, bool _keypoints) : keypoints(_keypoints) {
+    std::vector<osg::Vec3> points;
+    VertexCollector collector(points);
+    model->accept(collector);
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    for (int i = 0; i < points.size(); i++) {
+        box.expandBy(points[i]);
+    }
+    std::vector<int> indices = convexHull(points);
+    for (int i = 0; i < indices.size(); i++) {
+        hull.push_back(points[indices[i]]);
+    }
+}
+
+//destructor
+Annotator::~Annotator() {
+}
+
+//Expands box in pixels of output image with origin at top left corner by projected point.
+static void expandBox(const osg::Vec4d &p, double height, double &xMin, double &yMin, double &xMax, double &yMax) {
+    double x = p.x() / p.w();
+    double y = height - p.y() / p.w();
+    xMin = osg::minimum(xMin, x);
+    xMax = osg::maximum(xMax, x);
+    yMin = osg::minimum(yMin, y);
+    yMax = osg::maximum(yMax, y);
+}
+
+/**
+    Appends annotations of all objects to current row of labels: xmin, ymin, xmax, ymax of box
+    in pixels of output image with origin at top left corner, visible and truncated flags, then
+    x, y, visible flag of every keypoint. Box of invisible object is zero.
+    @param transforms the transformations of objects.
+    @param viewProjection the matrix of camera view, projection and viewport window.
+    @param width the double width of viewport.
+    @param height the double height of viewport.
+    @param labels the writer of labels row.
+*/
+void Annotator::annotate(const std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms,
+        const osg::Matrixd &viewProjection, double width, double height, LabelWriter &labels) {
+    for (int i = 0; i < transforms.size(); i++) {
+        osg::Matrixd model;
+        transforms[i]->computeLocalToWorldMatrix(model, NULL);
+        osg::Matrixd m = model * viewProjection;
+        std::vector<osg::Vec4d> projected(hull.size());
+        double wMax = 0.0;
+        for (int j = 0; j < hull.size(); j++) {
+            projected[j] = osg::Vec4d(hull[j], 1.0) * m;
+            wMax = osg::maximum(wMax, projected[j].w());
+        }
+        //near plane is computed by osg from scene bounds every frame, hull is clipped close to camera plane
+        double wClip = wMax * CLIP_DISTANCE;
+        double xMin = DBL_MAX, yMin = DBL_MAX, xMax = -DBL_MAX, yMax = -DBL_MAX;
+        std::vector<int> front;
+        std::vector<int> back;
+        for (int j = 0; j < hull.size(); j++) {
+            if (wMax > 0.0 && projected[j].w() >= wClip) {
+                front.push_back(j);
+            }
+            else {
+                back.push_back(j);
+            }
+        }
+        //clipped hull is spanned by front vertices and intersections of segments to back vertices with clip plane
+        for (int j = 0; j < front.size(); j++) {
+            const osg::Vec4d &a = projected[front[j]];
+            expandBox(a, height, xMin, yMin, xMax, yMax);
+            for (int k = 0; k < back.size(); k++) {
+                const osg::Vec4d &b = projected[back[k]];
+                expandBox(a + (b - a) * ((wClip - a.w()) / (b.w() - a.w())), height, xMin, yMin, xMax, yMax);
+            }
+        }
+        bool behind = !back.empty();
+        bool truncated = behind || xMin < 0.0 || yMin < 0.0 || xMax > width || yMax > height;
+        xMin = osg::clampBetween(xMin, 0.0, width);
+        xMax = osg::clampBetween(xMax, 0.0, width);
+        yMin = osg::clampBetween(yMin, 0.0, height);
+        yMax = osg::clampBetween(yMax, 0.0, height);
+        bool visible = xMax > xMin && yMax > yMin;
+        if (!visible) {
+            xMin = yMin = xMax = yMax = 0.0;
+        }
+        labels.addNumber(xMin);
+        labels.addNumber(yMin);
+        labels.addNumber(xMax);
+        labels.addNumber(yMax);
+        labels.addNumber(visible ? 1 : 0);
+        labels.addNumber(truncated ? 1 : 0);
+        if (!keypoints) {
+            continue;
+        }
+        for (int j = 0; j < KEYPOINTS; j++) {
+            osg::Vec4d p = osg::Vec4d(box.corner(j), 1.0) * m;
+            double x = 0.0, y = 0.0;
+            bool inside = false;
+            if (p.w() > 0.0) {
+                x = p.x() / p.w();
+                y = height - p.y() / p.w();
+                inside = x >= 0.0 && x <= width && y >= 0.0 && y <= height;
+            }
+            labels.addNumber(x);
+            labels.addNumber(y);
+            labels.addNumber(inside ? 1 : 0);
+        }
+    }
+}
+
+/**
+    Appends names of annotation columns to labels columns.
+    @param columns the names of labels columns.
+    @param objects the int count of objects.
+    @param keypoints whether keypoints are written.
+*/
+void Annotator::addColumns(std::vector<std::string> &columns, int objects, bool keypoints) {
+    const char* names[] = {"xmin", "ymin", "xmax", "ymax", "visible", "truncated"};
+    for (int i = 0; i < objects; i++) {
+        std::ostringstream ss;
+        ss << "o" << i << "_";
+        std::string object = ss.str();
+        for (int k = 0; k < 6; k++) {
+            columns.push_back(object + names[k]);
+        }
+        if (!keypoints) {
+            continue;
+        }
+        for (int j = 0; j < KEYPOINTS; j++) {
+            std::ostringstream point;
+            point << object << "k" << j;
+            columns.push_back(point.str() + "x");
+            columns.push_back(point.str() + "y");
+            columns.push_back(point.str() + "v");
+        }
+    }
+}
@@ -0,0 +1,163 @@
+#include "BackgroundCache.h"
+
+#include <OpenThreads/ScopedLock>
+
+#include <algorithm>
+#include <string.h>
+
+//constructor
+BackgroundCache::BackgroundCache(Configurator& cfg, int _capacity, int _prefetchCount) : config(cfg) {
+    files = config.getBackgroundFiles();
+    prefetchCount = _prefetchCount > 0 ? _prefetchCount : 0;
+    //cache keeps the current image and all prefetched ones
+    capacity = _capacity > prefetchCount + 1 ? _capacity : prefetchCount + 2;
+    done = false;
+    prefetcher = NULL;
+    if (prefetchCount > 0 && !files.empty()) {
+        prefetcher = new Prefetcher(this);
+        prefetcher->start();
+    }
+}
+
+//destructor, stops prefetch thread
+BackgroundCache::~BackgroundCache() {
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(cacheMutex);
+        done = true;
+        prefetchRequested.broadcast();
+    }
+    if (prefetcher) {
+        prefetcher->join();
+        delete prefetcher;
+    }
+}
+
+/**
+    Returns background image with specified index, decodes it if not cached.
+    Requests prefetch of images following the index.
+    @param index the int index of background file.
+    @return background image scaled to render size
+*/
+osg::ref_ptr<osg::Image> BackgroundCache::get(int index) {
+    osg::ref_ptr<osg::Image> image;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(cacheMutex);
+        schedulePrefetch(index);
+        //image queued but not taken by prefetch thread yet is decoded here
+        std::deque<int>::iterator queued = std::find(prefetchQueue.begin(), prefetchQueue.end(), index);
+        if (queued != prefetchQueue.end()) {
+            prefetchQueue.erase(queued);
+            pending.erase(index);
+        }
+        //wait if the image is being decoded by prefetch thread
+        while (entries.find(index) == entries.end() && pending.count(index) > 0) {
+            imageLoaded.wait(&cacheMutex);
+        }
+        std::map<int, Entry>::iterator it = entries.find(index);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second.lruPos);
+            return it->second.image;
+        }
+    }
+    image = load(index);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(cacheMutex);
+    insert(index, image.get());
+    return image;
+}
+
+/**
+    Decodes background file and scales it to render size.
+    Image of unreadable file is replaced with black image, so indices stay stable.
+    @param index the int index of background file.
+    @return background image
+*/
+osg::ref_ptr<osg::Image> BackgroundCache::load(int index) {
+    osg::ref_ptr<osg::Image> image = config.loadBackgroundImage(files[index]);
+    if (!image.valid()) {
+        Output o = config.getOutput();
+        image = new osg::Image;
+        image->allocateImage(o.renderWidth, o.renderHeight, 1, GL_RGB, GL_UNSIGNED_BYTE, 1);
+        memset(image->data(), 0, image->getTotalSizeInBytes());
+    }
+    return image;
+}
+
+/**
+    Inserts image into cache as most recently used, evicts least recently used images.
+    Should be called with locked mutex.
+    @param index the int index of background file.
+    @param image the decoded image.
+*/
+void BackgroundCache::insert(int index, osg::Image* image) {
+    std::map<int, Entry>::iterator it = entries.find(index);
+    if (it != entries.end()) {
+        lru.splice(lru.begin(), lru, it->second.lruPos);
+        return;
+    }
+    lru.push_front(index);
+    Entry entry;
+    entry.image = image;
+    entry.lruPos = lru.begin();
+    entries[index] = entry;
+    while (entries.size() > capacity) {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+}
+
+/**
+    Queues indices following specified one for prefetch. Should be called with locked mutex.
+    @param index the int index of requested background file.
+*/
+void BackgroundCache::schedulePrefetch(int index) {
+    if (!prefetcher) {
+        return;
+    }
+    for (int i = 1; i <= prefetchCount && i < files.size(); i++) {
+        int next = (index + i) % files.size();
+        if (entries.find(next) == entries.end() && pending.count(next) == 0) {
+            pending.insert(next);
+            prefetchQueue.push_back(next);
+        }
+    }
+    prefetchRequested.signal();
+}
+
+/**
+    Takes next index to prefetch, waits while queue is empty.
+    @param index output index.
+    @return false if cache is stopped
+*/
+bool BackgroundCache::popPrefetch(int &index) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(cacheMutex);
+    while (prefetchQueue.empty() && !done) {
+        prefetchRequested.wait(&cacheMutex);
+    }
+    if (done) {
+        return false;
+    }
+    index = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    return true;
+}
+
+/**
+    Stores image decoded by prefetch thread and wakes up waiting get() calls.
+    @param index the int index of background file.
+    @param image the decoded image.
+*/
+void BackgroundCache::prefetched(int index, osg::Image* image) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(cacheMutex);
+    insert(index, image);
+    pending.erase(index);
+    imageLoaded.broadcast();
+}
+
+//Thread body, decodes queued images.
+void BackgroundCache::Prefetcher::run() {
+    int index;
+    while (cache->popPrefetch(index)) {
+        osg::ref_ptr<osg::Image> image = cache->load(index);
+        cache->prefetched(index, image.get());
+    }
+}
@@ -0,0 +1,180 @@
+#include "Checkpoint.h"
+
+#include <osg/Notify>
+
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+
+/**
+    Constructor, opens manifest. Manifest of previous run is continued on resume, replaced otherwise.
+    @param _manifestFile path to manifest file.
+    @param resume skip images committed by previous run.
+    @param _interval the double minimal time between commits in seconds.
+*/
+Checkpoint::Checkpoint(const std::string &_manifestFile, bool resume, double _interval)
+    : manifestFile(_manifestFile), interval(_interval) {
+    lastDone = 0;
+    doneSize = 0;
+    doneBinarySize = 0;
+    fragment = NULL;
+    binaryFragment = NULL;
+    if (resume && readManifest()) {
+        osg::notify(osg::NOTICE) << "Resuming after image " << lastDone << " of '" << manifestFile << "'" << std::endl;
+    }
+    manifest = fopen(manifestFile.c_str(), resume ? "ab" : "wb");
+    if (!manifest) {
+        osg::notify(osg::WARN) << "Manifest '" << manifestFile << "' can not be written" << std::endl;
+    }
+    lastCommit = osg::Timer::instance()->tick();
+}
+
+//destructor
+Checkpoint::~Checkpoint() {
+    labels.setFile(NULL);
+    if (fragment) {
+        fclose(fragment);
+    }
+    if (binaryFragment) {
+        fclose(binaryFragment);
+    }
+    if (manifest) {
+        fclose(manifest);
+    }
+}
+
+/**
+    Reads last complete line of manifest. Lines are "index size binarySize fragment", manifests
+    written before binary labels have lines "index size fragment", binary size is 0 then.
+    @return true if a committed index is found
+*/
+bool Checkpoint::readManifest() {
+    std::ifstream file(manifestFile.c_str());
+    std::string line;
+    bool found = false;
+    while (std::getline(file, line)) {
+        //line without end of line is interrupted write
+        if (file.eof()) {
+            break;
+        }
+        std::istringstream ss(line);
+        int index;
+        long size;
+        long binarySize = 0;
+        std::string name;
+        if (!(ss >> index >> size) || !std::getline(ss >> std::ws, name)) {
+            continue;
+        }
+        //binary size is present if number is followed by fragment name
+        size_t space = name.find(' ');
+        size_t nameStart = name.find_first_not_of(' ', space);
+        if (space != std::string::npos && nameStart != std::string::npos
+                && name.find_first_not_of("0123456789") == space) {
+            binarySize = atol(name.c_str());
+            name = name.substr(nameStart);
+        }
+        if (!name.empty()) {
+            lastDone = index;
+            doneSize = size;
+            doneBinarySize = binarySize;
+            doneFragment = name;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+    Switches label rows to fragments of other folder. Fragments of last committed folder
+    are truncated to committed sizes, others are started empty.
+    @param fileName path to labels fragment.
+    @param binaryFileName path to binary labels fragment, or empty if binary labels are not written.
+*/
+void Checkpoint::setFragment(const std::string &fileName, const std::string &binaryFileName) {
+    if (fileName == fragmentFile) {
+        return;
+    }
+    labels.setFile(NULL);
+    if (fragment) {
+        fclose(fragment);
+    }
+    if (binaryFragment) {
+        fclose(binaryFragment);
+        binaryFragment = NULL;
+    }
+    bool committed = fileName == doneFragment;
+    fragmentFile = fileName;
+    binaryFragmentFile = binaryFileName;
+    fragment = openFragment(fileName, committed, doneSize);
+    if (!binaryFileName.empty()) {
+        binaryFragment = openFragment(binaryFileName, committed, doneBinarySize);
+    }
+    labels.setFile(fragment, binaryFragment);
+}
+
+/**
+    Opens fragment for writing, committed fragment is continued after truncation to its committed size.
+    @param fileName path to fragment.
+    @param committed whether fragment belongs to last committed folder.
+    @param size the long committed size of fragment.
+    @return opened file, or NULL if fragment can not be written
+*/
+FILE* Checkpoint::openFragment(const std::string &fileName, bool committed, long size) {
+    FILE* file;
+    if (committed && truncate(fileName.c_str(), size) == 0) {
+        file = fopen(fileName.c_str(), "ab");
+    }
+    else {
+        file = fopen(fileName.c_str(), "wb");
+    }
+    if (!file) {
+        osg::notify(osg::WARN) << "Labels fragment '" << fileName << "' can not be written" << std::endl;
+    }
+    return file;
+}
+
+/**
+    Checks whether commit interval has elapsed since last commit.
+    @return true if progress should be committed
+*/
+bool Checkpoint::isDue() const {
+    return osg::Timer::instance()->delta_s(lastCommit, osg::Timer::instance()->tick()) >= interval;
+}
+
+/**
+    Flushes label rows to current fragment and records index in manifest.
+    Caller ensures all images up to index are saved.
+    @param index the int index of last saved image.
+    @return false if files can not be written
+*/
+bool Checkpoint::commit(int index) {
+    lastCommit = osg::Timer::instance()->tick();
+    if (!fragment || !manifest) {
+        return false;
+    }
+    if (!labels.flush() || fflush(fragment) != 0) {
+        return false;
+    }
+    fsync(fileno(fragment));
+    long size = ftell(fragment);
+    long binarySize = 0;
+    if (binaryFragment) {
+        if (fflush(binaryFragment) != 0) {
+            return false;
+        }
+        fsync(fileno(binaryFragment));
+        binarySize = ftell(binaryFragment);
+    }
+    fprintf(manifest, "%d %ld %ld %s\n", index, size, binarySize, fragmentFile.c_str());
+    if (fflush(manifest) != 0) {
+        return false;
+    }
+    fsync(fileno(manifest));
+    lastDone = index;
+    doneFragment = fragmentFile;
+    doneSize = size;
+    doneBinarySize = binarySize;
+    return true;
+}
@@ -1,4 +1,7 @@
 #include "Configurator.h"
+#include "Resampler.h"
+#include "Profiler.h"
+#include "ModelLoader.h"
 #include <json/json.h>
 
 #include <dirent.h>
@@ -9,12 +12,41 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <time.h>
 
 //constructor
 Configurator::Configurator() {
     //initialize
     output.width = 800;
     output.numObjects = 1;
+    bgCache = 64;
+    bgPrefetch = 8;
+    doGpuBgAugmentation = false;
+    loadThreads = 0;
+    seed = 0;
+    optimizeModels = false;
+    targetTriangles = 0;
+    output.headless = false;
+    output.pboCount = 0;
+    output.writerThreads = 0;
+    output.writerQueueSize = 16;
+    output.idMasks = false;
+    output.supersample = 0;
+    output.renderWidth = 800;
+    output.renderHeight = 0;
+    output.instancing = false;
+    output.renderContexts = 1;
+    output.checkpointInterval = 5.0;
+    output.binaryLabels = false;
+    output.annotations = false;
+    output.keypoints = false;
+    output.maskFormat = "image";
+    output.packedShards = false;
+    output.shardSizeMb = 1024;
+    output.streamSlots = 8;
+    output.streamSlotMb = 16;
+    output.streamTimeout = 5.0;
+    output.streamEncoded = false;
 }
 
 //destructor
@@ -46,10 +78,25 @@ int Configurator::parse(const std::string &filename) {
     Json::StyledWriter writer;
     jsonString = writer.write(config);
     Json::Value generator = config["generator"];
+    if (generator.isMember("seed")) {
+        seed = generator["seed"].asUInt64();
+    }
+    else {
+        //shards and repeated runs generate the same images only with configured seed
+        seed = time(0);
+        std::cout << "seed is not configured, using " << seed << std::endl;
+    }
     std::string bg_folder = generator["input"]["background_folder"].asString();
     std::string model_folder = generator["input"]["model_folder"].asString();
     mask_bg_file = generator["input"]["mask_background"].asString();
     doBgAugmentation = generator["input"]["bg_augmentation"].asBool();
+    doGpuBgAugmentation = generator["input"].get("bg_augmentation_mode", "cpu").asString() == "gpu";
+    bgCache = generator["input"].get("bg_cache_size", 64).asInt();
+    bgPrefetch = generator["input"].get("bg_prefetch", 8).asInt();
+    loadThreads = generator["input"].get("load_threads", 0).asInt();
+    modelCacheFolder = generator["input"].get("model_cache", "").asString();
+    optimizeModels = generator["input"]["optimize_models"].asBool();
+    targetTriangles = generator["input"]["target_triangles"].asInt();
     output.width = generator["output"]["size"]["width"].asInt();
     output.height = generator["output"]["size"]["height"].asInt();
     output.folder = generator["output"]["output_folder"].asString();
@@ -57,6 +104,44 @@ int Configurator::parse(const std::string &filename) {
     output.numMultiSamples = generator["output"]["num_multi_samples"].asInt();
     output.maskFolder = generator["output"]["mask_folder"].asString();
     output.numObjects = generator["output"]["num_objects"].asInt();
+    output.headless = generator["output"]["headless"].asBool();
+    output.pboCount = generator["output"]["pbo_count"].asInt();
+    output.writerThreads = generator["output"]["writer_threads"].asInt();
+    output.writerQueueSize = generator["output"].get("writer_queue_size", 16).asInt();
+    output.idMasks = generator["output"]["id_masks"].asBool();
+    output.supersample = generator["output"]["supersample"].asInt();
+    output.instancing = generator["output"]["instancing"].asBool();
+    output.renderContexts = generator["output"].get("render_contexts", 1).asInt();
+    output.checkpointInterval = generator["output"].get("checkpoint_interval", 5.0).asDouble();
+    output.binaryLabels = generator["output"]["binary_labels"].asBool();
+    output.annotations = generator["output"]["annotations"].asBool();
+    output.keypoints = generator["output"]["keypoints"].asBool();
+    output.maskFormat = generator["output"].get("mask_format", "image").asString();
+    output.packedShards = generator["output"]["packed_shards"].asBool();
+    output.shardSizeMb = generator["output"].get("shard_size_mb", 1024).asInt();
+    output.streamName = generator["output"]["stream_name"].asString();
+    output.streamSlots = generator["output"].get("stream_slots", 8).asInt();
+    output.streamSlotMb = generator["output"].get("stream_slot_mb", 16).asInt();
+    output.streamTimeout = generator["output"].get("stream_timeout", 5.0).asDouble();
+    output.streamEncoded = generator["output"]["stream_encoded"].asBool();
+    if (!output.streamName.empty()) {
+        //shm_open name is a single path component with leading slash
+        if (output.streamName[0] != '/') {
+            output.streamName = "/" + output.streamName;
+        }
+        if (output.streamName.find('/', 1) != std::string::npos) {
+            std::cout << "stream_name must not contain '/' except leading one\n";
+            return 1;
+        }
+    }
+    if (output.supersample > 0) {
+        output.renderWidth = output.width * output.supersample;
+        output.renderHeight = output.height * output.supersample;
+    }
+    else {
+        output.renderWidth = 800;
+        output.renderHeight = output.renderWidth * output.height / output.width;
+    }
     if (output.numObjects == 0) {
         output.numObjects = 1;
     }
@@ -173,23 +258,19 @@ bool Configurator::hasExtension(const std::string &fileName, const std::string &
 }
 
 /**
-    Loads list of background images.
-    @return vector of osg::Image objects.
+    Loads background image and scales it to render size.
+    @param filename path to image file.
+    @return osg::Image object, or NULL if file can not be read
 */
-std::vector<osg::Image*> Configurator::loadBackground() {
-    int bgWidth = 800;
-    int bgHeight = bgWidth * getOutput().height / getOutput().width;
-    std::vector<osg::Image*> bgImages;
-    for (int i = 0; i < bg_files.size(); i++) {
-        std::string filename = bg_files[i];
-        osg::Image* image = osgDB::readImageFile (filename);
-        if (!image) {
-            osg::notify(osg::NOTICE)<<"Background image file '"<<filename<<"' not found"<<std::endl;
-        }
-        image->scaleImage(bgWidth, bgHeight, image->r());
-        bgImages.push_back(image);
+osg::Image* Configurator::loadBackgroundImage(const std::string &filename) {
+    StageTimer timer(Profiler::BACKGROUND_DECODE);
+    osg::Image* image = osgDB::readImageFile (filename);
+    if (!image) {
+        osg::notify(osg::NOTICE)<<"Background image file '"<<filename<<"' not found"<<std::endl;
+        return NULL;
     }
-    return bgImages;
+    scaleImage(*image, output.renderWidth, output.renderHeight);
+    return image;
 }
 
 /**
@@ -197,31 +278,30 @@ std::vector<osg::Image*> Configurator::loadBackground() {
     @return osg::Image object.
 */
 osg::Image* Configurator::loadMaskBackground() {
-    int bgWidth = 800;
-    int bgHeight = bgWidth * getOutput().height / getOutput().width;
+    int bgWidth = output.renderWidth;
+    int bgHeight = output.renderHeight;
     osg::Image* image = osgDB::readImageFile (mask_bg_file);
     if (!image) {
         osg::notify(osg::NOTICE)<<"Mask background image file '"<<mask_bg_file<<"' not found"<<std::endl;
     }
-    image->scaleImage(bgWidth, bgHeight, image->r());
+    scaleImage(*image, bgWidth, bgHeight);
     return image;
 }
 
 /**
-    Loads list of 3D models
+    Loads list of 3D models concurrently, by load_threads worker threads.
+    Models are optimized if optimize_models is set.
     @return map containing loaded models as osg::Node objects
 */
 std::map<std::string, osg::Node*> Configurator::loadModels() {
-    std::map<std::string, osg::Node*> models;
-    std::vector<std::string> fileList;
-    for (int i = 0; i < model_files.size(); i++) {
-        std::string filename = model_files[i];
-        fileList.push_back(filename);
-        osg::Node* model = osgDB::readNodeFiles(fileList);
-        fileList.clear();
-        if (model) {
-            models[filename] = model;
-        }
+    osg::ref_ptr<ModelOptimizer> optimizer;
+    if (optimizeModels) {
+        optimizer = new ModelOptimizer(targetTriangles);
+    }
+    osg::ref_ptr<ModelCache> cache;
+    if (!modelCacheFolder.empty()) {
+        cache = new ModelCache(modelCacheFolder, optimizer.valid() ? optimizer->getSignature() : "");
     }
-    return models;
+    ModelLoader loader(model_files, loadThreads, cache.get(), optimizer.get());
+    return loader.load();
 }
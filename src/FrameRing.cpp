@@ -0,0 +1,167 @@
+#include "FrameRing.h"
+
+#include <osg/Notify>
+#include <osg/Timer>
+#include <OpenThreads/ScopedLock>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+//size of ring and slot headers
+static const uint64_t HEADER_SIZE = 64;
+
+/**
+    Constructor, creates shared memory object and initializes empty ring.
+    @param _name the name of shared memory object, starts with '/'.
+    @param _slotCount the int count of slots.
+    @param _slotSize the size of slot in bytes, including slot header.
+    @param _waitTimeout the double max time in seconds to wait for a free slot.
+*/
+FrameRing::FrameRing(const std::string &_name, int _slotCount, uint64_t _slotSize, double _waitTimeout)
+    : name(_name), waitTimeout(_waitTimeout) {
+    header = NULL;
+    stalled = false;
+    droppedCount = 0;
+    uint64_t slotSize = (_slotSize + 7) / 8 * 8;
+    mappedSize = HEADER_SIZE + slotSize * _slotCount;
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, mappedSize) != 0) {
+        osg::notify(osg::WARN) << "Shared memory '" << name << "' can not be created" << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    void* memory = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        osg::notify(osg::WARN) << "Shared memory '" << name << "' can not be mapped" << std::endl;
+        return;
+    }
+    header = (Header*)memory;
+    memset(header, 0, HEADER_SIZE);
+    header->version = 1;
+    header->slotCount = _slotCount;
+    header->slotSize = slotSize;
+    //magic is stored last, consumer waits for it before reading other fields
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, "IMGRING", 8);
+    osg::notify(osg::NOTICE) << "Streaming to shared memory '" << name << "', " << _slotCount
+        << " slots of " << slotSize << " bytes" << std::endl;
+}
+
+//destructor, marks ring closed, shared memory object stays for consumer
+FrameRing::~FrameRing() {
+    if (header) {
+        __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+        munmap(header, mappedSize);
+    }
+}
+
+/**
+    Waits for a free slot and writes record header and name into it.
+    @param kind the Kind of record.
+    @param format the Format of data.
+    @param fileName file name of image.
+    @param size the size of data in bytes.
+    @param width the int width of raw image.
+    @param height the int height of raw image.
+    @param channels the int count of channels of raw image.
+    @return pointer to data of record, or NULL if record does not fit into slot or ring stays full
+*/
+char* FrameRing::beginRecord(int kind, int format, const std::string &fileName, uint64_t size,
+        int width, int height, int channels) {
+    uint64_t dataOffset = HEADER_SIZE + (fileName.size() + 7) / 8 * 8;
+    if (dataOffset + size > header->slotSize) {
+        osg::notify(osg::WARN) << "Record '" << fileName << "' of " << size << " bytes does not fit into ring slot" << std::endl;
+        return NULL;
+    }
+    uint64_t n = header->writeCount;
+    //consumer frees slots by advancing read counter
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    while (n - __atomic_load_n(&header->readCount, __ATOMIC_ACQUIRE) >= header->slotCount) {
+        if (stalled || osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick()) >= waitTimeout) {
+            if (!stalled) {
+                osg::notify(osg::WARN) << "No slot of shared memory '" << name << "' is freed in " << waitTimeout
+                    << " seconds, records are dropped until consumer reads the ring" << std::endl;
+            }
+            stalled = true;
+            droppedCount++;
+            return NULL;
+        }
+        usleep(1000);
+    }
+    if (stalled) {
+        osg::notify(osg::NOTICE) << "Consumer of shared memory '" << name << "' resumed, "
+            << droppedCount << " records dropped" << std::endl;
+        stalled = false;
+        droppedCount = 0;
+    }
+    char* slotData = (char*)header + HEADER_SIZE + (n % header->slotCount) * header->slotSize;
+    Slot* slot = (Slot*)slotData;
+    memset(slot, 0, HEADER_SIZE);
+    slot->sequence = n;
+    slot->kind = kind;
+    slot->format = format;
+    slot->width = width;
+    slot->height = height;
+    slot->channels = channels;
+    slot->nameSize = fileName.size();
+    slot->dataSize = size;
+    memcpy(slotData + HEADER_SIZE, fileName.data(), fileName.size());
+    return slotData + dataOffset;
+}
+
+//Publishes record written after beginRecord.
+void FrameRing::endRecord() {
+    __atomic_store_n(&header->writeCount, header->writeCount + 1, __ATOMIC_RELEASE);
+}
+
+/**
+    Publishes raw 8-bit pixels of image, rows are reordered from bottom-up to top-down.
+    @param fileName file name of image.
+    @param image the image.
+    @return false if image is not published
+*/
+bool FrameRing::publishImage(const std::string &fileName, const osg::Image &image) {
+    if (!header || image.getDataType() != GL_UNSIGNED_BYTE) {
+        return false;
+    }
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mutex);
+    int channels = osg::Image::computeNumComponents(image.getPixelFormat());
+    uint64_t rowSize = (uint64_t)image.s() * channels;
+    char* data = beginRecord(IMAGE, RAW, fileName, rowSize * image.t(), image.s(), image.t(), channels);
+    if (!data) {
+        return false;
+    }
+    for (int row = 0; row < image.t(); row++) {
+        memcpy(data + row * rowSize, image.data(0, image.t() - 1 - row), rowSize);
+    }
+    endRecord();
+    return true;
+}
+
+/**
+    Publishes encoded image or text record.
+    @param kind the Kind of record.
+    @param format the Format of data.
+    @param fileName file name of image.
+    @param data the record data.
+    @param size the size of data in bytes.
+    @return false if record is not published
+*/
+bool FrameRing::publish(int kind, int format, const std::string &fileName, const char* data, uint64_t size) {
+    if (!header) {
+        return false;
+    }
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mutex);
+    char* dst = beginRecord(kind, format, fileName, size, 0, 0, 0);
+    if (!dst) {
+        return false;
+    }
+    memcpy(dst, data, size);
+    endRecord();
+    return true;
+}
@@ -0,0 +1,178 @@
+#include "ImageWriter.h"
+#include "Resampler.h"
+#include "Profiler.h"
+
+#include <osg/Notify>
+#include <osgDB/WriteFile>
+#include <osgDB/Registry>
+#include <osgDB/FileNameUtils>
+#include <OpenThreads/ScopedLock>
+
+#include <iostream>
+#include <sstream>
+
+//constructor
+ImageWriter::ImageWriter(int _outputWidth, int numThreads, int _queueSize) {
+    outputWidth = _outputWidth;
+    queueSize = _queueSize > 0 ? _queueSize : 1;
+    activeJobs = 0;
+    done = false;
+    encodeFrames = false;
+    for (int i = 0; i < numThreads; i++) {
+        Worker* worker = new Worker(this);
+        workers.push_back(worker);
+        worker->start();
+    }
+}
+
+//destructor, saves queued images and stops writer threads
+ImageWriter::~ImageWriter() {
+    flush();
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(queueMutex);
+        done = true;
+        notEmpty.broadcast();
+    }
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+/**
+    Queues image to be saved by writer threads, blocks while queue is full.
+    The writer takes ownership of the image, it should not be modified by caller later.
+    @param image the image read back from frame buffer.
+    @param fileName file name to save image.
+*/
+void ImageWriter::write(osg::Image* image, const std::string& fileName) {
+    if (workers.empty()) {
+        saveImage(image, fileName, scratchImage);
+        return;
+    }
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(queueMutex);
+    while (queue.size() >= queueSize) {
+        notFull.wait(&queueMutex);
+    }
+    Job job;
+    job.image = image;
+    job.fileName = fileName;
+    queue.push_back(job);
+    notEmpty.signal();
+}
+
+/**
+    Blocks until all queued images are saved, packed images are written to disk.
+*/
+void ImageWriter::flush() {
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(queueMutex);
+        while (!queue.empty() || activeJobs > 0) {
+            idle.wait(&queueMutex);
+        }
+    }
+    if (shardWriter.valid()) {
+        shardWriter->flush();
+    }
+}
+
+/**
+    Takes next job from queue, waits while queue is empty.
+    @param job output job.
+    @return false if writer is stopped and queue is empty
+*/
+bool ImageWriter::pop(Job& job) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(queueMutex);
+    while (queue.empty() && !done) {
+        notEmpty.wait(&queueMutex);
+    }
+    if (queue.empty()) {
+        return false;
+    }
+    job = queue.front();
+    queue.pop_front();
+    activeJobs++;
+    notFull.signal();
+    return true;
+}
+
+//Marks job taken by pop() as finished.
+void ImageWriter::jobDone() {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(queueMutex);
+    activeJobs--;
+    if (queue.empty() && activeJobs == 0) {
+        idle.broadcast();
+    }
+}
+
+/**
+    Scales image to output width and saves it to a file, publishes it to frame ring, or packs it into shard.
+    @param image the image read back from frame buffer.
+    @param fileName file name to save image.
+    @param scratch the image reused to store scaled pixels, reallocated when output size changes.
+*/
+void ImageWriter::saveImage(osg::Image* image, const std::string& fileName, osg::ref_ptr<osg::Image> &scratch) {
+    osg::Image* output = image;
+    int w = image->s();
+    int h = image->t();
+    int t = outputWidth * h / w;
+    if (w != outputWidth) {
+        StageTimer timer(Profiler::SCALE);
+        if (!scratch.valid() || scratch->s() != outputWidth || scratch->t() != t
+                || scratch->getPixelFormat() != image->getPixelFormat()) {
+            scratch = new osg::Image;
+            scratch->allocateImage(outputWidth, t, 1, image->getPixelFormat(), GL_UNSIGNED_BYTE, 1);
+        }
+        if (resampleImage(*image, *scratch)) {
+            output = scratch.get();
+        }
+        else {
+            image->scaleImage(outputWidth, t, 1);
+        }
+    }
+
+    if (frameRing.valid() && !encodeFrames) {
+        StageTimer timer(Profiler::WRITE);
+        frameRing->publishImage(fileName, *output);
+        return;
+    }
+    if (frameRing.valid() || shardWriter.valid()) {
+        //image is encoded by plugin of file extension into memory
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(
+            osgDB::getLowerCaseFileExtension(fileName));
+        std::ostringstream data;
+        bool encoded;
+        {
+            StageTimer timer(Profiler::ENCODE);
+            encoded = rw && rw->writeImage(*output, data).success();
+        }
+        StageTimer timer(Profiler::WRITE);
+        if (!encoded) {
+            osg::notify(osg::WARN) << "Image `" << fileName << "` can not be encoded" << std::endl;
+        }
+        else if (frameRing.valid()) {
+            std::string bytes = data.str();
+            frameRing->publish(FrameRing::IMAGE, FrameRing::ENCODED, fileName, bytes.data(), bytes.size());
+        }
+        else {
+            shardWriter->append(fileName, data.str());
+        }
+        return;
+    }
+    //encoding and writing of file are not separable
+    StageTimer timer(Profiler::WRITE);
+    if (osgDB::writeImageFile(*output, fileName)) {
+        std::cout << "Saved screen image to `"<<fileName<<"`"<< std::endl;
+    }
+}
+
+//Thread body, saves queued images.
+void ImageWriter::Worker::run() {
+    Job job;
+    while (writer->pop(job)) {
+        writer->saveImage(job.image.get(), job.fileName, scratch);
+        job.image = NULL;
+        writer->jobDone();
+    }
+}
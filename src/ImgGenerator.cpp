@@ -1,20 +1,37 @@
 #include "ImgGenerator.h"
+#include "Shaders.h"
+#include "Resampler.h"
+#include "BackgroundCache.h"
+#include "InstancedModel.h"
+#include "Checkpoint.h"
+#include "Annotator.h"
+#include "Profiler.h"
+
+#include <OpenThreads/ScopedLock>
 
 #include <string>
 #include <sstream>
 #include <iomanip>
 #include <unistd.h>
+#include <dirent.h>
 #include <sys/stat.h>
 
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <algorithm>
 #include <memory.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 //constructor
 ImgGenerator::ImgGenerator(Configurator& cfg) {
     config = cfg;
-    srand( time( 0 ) );
+    mode = 0;
+    shardIndex = 0;
+    shardCount = 1;
+    resume = false;
+    randomGenerator.setSeed(config.randomSeed());
 }
 
 //destructor
@@ -22,6 +39,9 @@ ImgGenerator::~ImgGenerator() {
 
 }
 
+//guards parent lists of models and images shared by render contexts
+static OpenThreads::Mutex sharedSceneMutex;
+
 //Utility method, number to string conversion
 template <typename T>
 std::string NumberToString(T pNumber) {
@@ -53,11 +73,6 @@ int getWidth10(int base) {
     return floor(log10(base)) + 1;
 }
 
-//returns a pseudo-random integer between specified min and max values
-int randint(int min, int max) {
-    return min + (rand() % static_cast<int>(max - min + 1));
-}
-
 //Creates a new directory, using specified path and directory name.
 int ImgGenerator::makeDir(std::string path, std::string name) {
     std::string command = "mkdir -p " + path + "/" + name;
@@ -102,6 +117,223 @@ void ImgGenerator::createLabels(std::string path, std::string content) {
     outfile.close();
 }
 
+//Returns file name of text or binary labels fragment written by specified shard.
+std::string ImgGenerator::labelsFragmentName(int index, int count, bool binary) {
+    std::ostringstream ss;
+    ss << "labels-" << index << "-of-" << count << (binary ? ".bin" : ".csv");
+    return ss.str();
+}
+
+/**
+    Returns columns of labels row: file, position, rotation and scale of image, then annotations
+    of objects if enabled. Binary record, int32 file index and float32 values, also holds position
+    of every object after scale if scene has several objects.
+    @param binary the columns of binary record.
+    @return vector of column names
+*/
+std::vector<std::string> ImgGenerator::labelColumns(bool binary) {
+    const char* names[] = {"file", "px", "py", "pz", "ax", "ay", "az", "s"};
+    std::vector<std::string> columns(names, names + 8);
+    Output o = config.getOutput();
+    int numObjects = o.numObjects;
+    if (binary && numObjects > 1) {
+        for (int i = 0; i < numObjects; i++) {
+            std::string object = "o" + NumberToString(i);
+            columns.push_back(object + "x");
+            columns.push_back(object + "y");
+            columns.push_back(object + "z");
+        }
+    }
+    if (o.annotations) {
+        Annotator::addColumns(columns, numObjects, o.keypoints);
+    }
+    //encoded mask is text, so it is not a part of binary record
+    if (!binary && maskFormat() == SaveImageCallback::MASK_RLE) {
+        columns.push_back("mask");
+    }
+    return columns;
+}
+
+/**
+    Returns format of masks configured by 'mask_format': 'image' (default) - images of output format,
+    'png' - single-channel PNG images, 'rle' - COCO compressed RLE strings in 'mask' column of labels.
+    @return SaveImageCallback::MaskFormat value
+*/
+int ImgGenerator::maskFormat() {
+    std::string format = config.getOutput().maskFormat;
+    if (format == "png") {
+        return SaveImageCallback::MASK_GRAY;
+    }
+    if (format == "rle") {
+        return SaveImageCallback::MASK_RLE;
+    }
+    return SaveImageCallback::MASK_IMAGE;
+}
+
+//Returns extension of mask files, single-channel masks are always PNG.
+std::string ImgGenerator::maskExtension() {
+    return maskFormat() == SaveImageCallback::MASK_IMAGE ? config.getOutput().extension : ".png";
+}
+
+/**
+    Joins binary labels fragments of folder into 'labels.npy', table of records which
+    can be memory mapped, e.g. numpy.load(path, mmap_mode='r').
+    @param path the path to output folder.
+    @param count the int count of fragments.
+    @return false if fragment is missing or table can not be written
+*/
+bool ImgGenerator::mergeBinaryLabels(std::string path, int count) {
+    std::vector<std::string> columns = labelColumns(true);
+    long recordSize = 4 * columns.size();
+    long totalSize = 0;
+    for (int s = 0; s < count; s++) {
+        struct stat sb;
+        if (stat((path + "/" + labelsFragmentName(s, count, true)).c_str(), &sb) != 0) {
+            osg::notify(osg::WARN)<<"Folder '"<<path<<"' has no binary labels fragment "<<s<<std::endl;
+            return false;
+        }
+        totalSize += sb.st_size;
+    }
+    if (totalSize % recordSize != 0) {
+        osg::notify(osg::WARN)<<"Binary labels fragments of folder '"<<path<<"' have incomplete records"<<std::endl;
+        return false;
+    }
+    std::string fileName = path + "/labels.npy";
+    std::ofstream outfile((fileName + ".tmp").c_str(), std::ios::binary);
+    outfile << LabelWriter::npyHeader(columns, totalSize / recordSize);
+    for (int s = 0; s < count; s++) {
+        std::ifstream fragment((path + "/" + labelsFragmentName(s, count, true)).c_str(), std::ios::binary);
+        if (fragment.peek() != std::ifstream::traits_type::eof()) {
+            outfile << fragment.rdbuf();
+        }
+    }
+    outfile.close();
+    if (!outfile || rename((fileName + ".tmp").c_str(), fileName.c_str()) != 0) {
+        osg::notify(osg::WARN)<<"Binary labels of folder '"<<path<<"' can not be written"<<std::endl;
+        return false;
+    }
+    for (int s = 0; s < count; s++) {
+        remove((path + "/" + labelsFragmentName(s, count, true)).c_str());
+    }
+    return true;
+}
+
+/**
+    Checks whether range of images has some images of current shard.
+    @param first the int zero-based global index of first image.
+    @param count the int count of images.
+    @param total the int count of all images.
+    @return true if ranges intersect
+*/
+bool ImgGenerator::hasShardImages(int first, int count, int total) {
+    long long from = (long long)total * shardIndex / shardCount;
+    long long to = (long long)total * (shardIndex + 1) / shardCount;
+    return first < to && first + count > from;
+}
+
+/**
+    Creates empty labels fragment if it does not exist, existing fragment is kept.
+    @param fileName path to fragment.
+*/
+void ImgGenerator::createEmptyFragment(std::string fileName) {
+    FILE* file = fopen(fileName.c_str(), "ab");
+    if (!file) {
+        osg::notify(osg::WARN)<<"Labels fragment '"<<fileName<<"' can not be written"<<std::endl;
+        return;
+    }
+    fclose(file);
+}
+
+/**
+    Checks whether image belongs to range of current shard. Ranges of shards are
+    contiguous and ordered by shard index, so joined fragments keep order of a single process run.
+    @param index the int zero-based global image index.
+    @param total the int count of all images.
+    @return true if image should be generated by this process
+*/
+bool ImgGenerator::isShardImage(int index, int total) {
+    long long from = (long long)total * shardIndex / shardCount;
+    long long to = (long long)total * (shardIndex + 1) / shardCount;
+    return index >= from && index < to;
+}
+
+/**
+    Joins labels fragments written by specified count of shards into 'labels.csv' of each
+    output folder, and binary fragments into 'labels.npy' if enabled, fragments are removed.
+    Folder is skipped if some fragment is missing.
+    Every render context of shard writes its own fragment.
+    @param shards the int count of shards.
+    @return 0 on success, or 1 if error occur
+*/
+int ImgGenerator::mergeLabels(int shards) {
+    Output o = config.getOutput();
+    int count = o.renderContexts > 1 ? shards * o.renderContexts : shards;
+    std::vector<std::string> folders;
+    folders.push_back(o.folder);
+    DIR* dir = opendir(o.folder.c_str());
+    if (dir == NULL) {
+        osg::notify(osg::NOTICE)<<"Output folder '"<<o.folder<<"' can not be opened"<<std::endl;
+        return 1;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        std::string path = o.folder + "/" + entry->d_name;
+        if (entry->d_name[0] != '.' && dirExists(path)) {
+            folders.push_back(path);
+        }
+    }
+    closedir(dir);
+    std::sort(folders.begin(), folders.end());
+    int result = 0;
+    for (int i = 0; i < folders.size(); i++) {
+        int found = 0;
+        for (int s = 0; s < count; s++) {
+            struct stat sb;
+            if (stat((folders[i] + "/" + labelsFragmentName(s, count)).c_str(), &sb) == 0) {
+                found++;
+            }
+        }
+        if (found == 0) {
+            continue;
+        }
+        if (found < count) {
+            osg::notify(osg::WARN)<<"Folder '"<<folders[i]<<"' has "<<found<<" of "<<count
+                <<" labels fragments, not merged"<<std::endl;
+            result = 1;
+            continue;
+        }
+        //fragments are copied by stream buffers, not loaded into memory
+        std::string fileName = folders[i] + "/labels.csv";
+        std::ofstream outfile((fileName + ".tmp").c_str());
+        std::vector<std::string> columns = labelColumns(false);
+        for (int c = 0; c < columns.size(); c++) {
+            outfile << (c > 0 ? "," : "") << columns[c];
+        }
+        outfile << "\n";
+        for (int s = 0; s < count; s++) {
+            std::ifstream fragment((folders[i] + "/" + labelsFragmentName(s, count)).c_str());
+            if (fragment.peek() != std::ifstream::traits_type::eof()) {
+                outfile << fragment.rdbuf();
+            }
+        }
+        outfile << std::endl;
+        outfile.close();
+        if (!outfile || rename((fileName + ".tmp").c_str(), fileName.c_str()) != 0) {
+            osg::notify(osg::WARN)<<"Labels of folder '"<<folders[i]<<"' can not be written"<<std::endl;
+            result = 1;
+            continue;
+        }
+        if (o.binaryLabels && !mergeBinaryLabels(folders[i], count)) {
+            result = 1;
+        }
+        for (int s = 0; s < count; s++) {
+            remove((folders[i] + "/" + labelsFragmentName(s, count)).c_str());
+        }
+        std::cout << "Merged labels of " << folders[i] << std::endl;
+    }
+    return result;
+}
+
 /**
     Creates camera to present a background texture
     @return pointer to osg Camera
@@ -154,6 +386,9 @@ osg::ref_ptr<osg::TextureRectangle> ImgGenerator::createBackgroundTexture(osg::C
     textureRect->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
     textureRect->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
     texturedQuad->getOrCreateStateSet()->setTextureAttributeAndModes(0, textureRect, osg::StateAttribute::ON);
+    //texture matrix applies GPU background augmentation, identity otherwise
+    bgTexMat = new osg::TexMat();
+    texturedQuad->getOrCreateStateSet()->setTextureAttribute(0, bgTexMat.get());
     texturedQuad->getOrCreateStateSet()->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
     pGeode->addDrawable(texturedQuad);
     bg_cam->addChild(pGeode);
@@ -162,30 +397,133 @@ osg::ref_ptr<osg::TextureRectangle> ImgGenerator::createBackgroundTexture(osg::C
 
 /**
     Fills traits, creates GraphicsContext and initializes camera of specified viewer.
+    In headless mode (generation modes only) the image is rendered into a single-buffered
+    pbuffer, so no window is mapped and no swap buffers / compositor round-trip is made per frame.
+    Pbuffer is created by GLX, so headless mode still needs X server of DISPLAY, e.g. Xvfb.
     @param bgWidth the int background width.
     @param bgHeight the int background height.
     @param viewer osg Viewer.
+    @return 0 on success, or 1 if graphics context can not be created
 */
-void ImgGenerator::initTraits(int bgWidth, int bgHeight, osgViewer::Viewer &viewer) {
+int ImgGenerator::initTraits(int bgWidth, int bgHeight, osgViewer::Viewer &viewer) {
     int xoffset = 0;
     int yoffset = 0;
+    bool headless = config.getOutput().headless && mode != 0;
     osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    if (headless && getenv("DISPLAY") == NULL) {
+        osg::notify(osg::FATAL)<<"Headless mode needs X server for pixel buffer, DISPLAY is not set"<<std::endl;
+        return 1;
+    }
+    traits->readDISPLAY();
+    traits->setUndefinedScreenDetailsToDefaultScreen();
     traits->x = xoffset + 0;
     traits->y = yoffset + 0;
     traits->width = bgWidth;
     traits->height = bgHeight;
     std::cout << "traits: " << traits->x << ", "<<traits->y <<", "<<traits->width<<", "<<traits->height<< std::endl;
-    traits->windowDecoration = true;
-    traits->doubleBuffer = true;
+    traits->windowDecoration = !headless;
+    traits->doubleBuffer = !headless;
+    traits->pbuffer = headless;
     traits->sharedContext = 0;
     traits->samples = config.getOutput().numMultiSamples;
 
     osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    if (!gc.valid() && headless) {
+        //window would be mapped on display, headless run must not fall back to it
+        osg::notify(osg::FATAL)<<"Unable to create pixel buffer of "<<traits->width<<"x"<<traits->height
+            <<" on display "<<traits->displayName()<<", headless rendering is not possible"<<std::endl;
+        return 1;
+    }
+    if (!gc.valid()) {
+        osg::notify(osg::FATAL)<<"Unable to create graphics context"<<std::endl;
+        return 1;
+    }
     viewer.getCamera()->setGraphicsContext(gc.get());
     viewer.getCamera()->setViewport(new osg::Viewport(0,0, traits->width, traits->height));
     GLenum buffer = traits->doubleBuffer ? GL_BACK : GL_FRONT;
     viewer.getCamera()->setDrawBuffer(buffer);
     viewer.getCamera()->setReadBuffer(buffer);
+    return 0;
+}
+
+/**
+    Creates callback saving rendered images, with writer threads pool and readback configured.
+    Images of every shard are published to its shared memory ring or packed into tar shards of output folder if enabled.
+    @return pointer to SaveImageCallback
+*/
+osg::ref_ptr<SaveImageCallback> ImgGenerator::createSaveImageCallback() {
+    Output o = config.getOutput();
+    osg::ref_ptr<SaveImageCallback> saveImageCallback = new SaveImageCallback(o.width);
+    saveImageCallback->setPboCount(o.pboCount);
+    osg::ref_ptr<ImageWriter> imageWriter = new ImageWriter(o.width, o.writerThreads, o.writerQueueSize);
+    if (!o.streamName.empty()) {
+        std::ostringstream name;
+        name << o.streamName << "-" << shardIndex << "-of-" << shardCount;
+        imageWriter->setFrameRing(new FrameRing(name.str(), o.streamSlots, (uint64_t)o.streamSlotMb << 20,
+            o.streamTimeout), o.streamEncoded);
+    }
+    else if (o.packedShards) {
+        std::ostringstream prefix;
+        prefix << o.folder << "/shard-" << shardIndex << "-of-" << shardCount;
+        imageWriter->setShardWriter(new ShardWriter(prefix.str(), o.folder, (long long)o.shardSizeMb << 20, resume));
+    }
+    saveImageCallback->setImageWriter(imageWriter.get());
+    return saveImageCallback;
+}
+
+/**
+    Switches viewer camera to single pass rendering of colour and object ID into
+    multiple render targets of frame buffer object. Background camera is drawn inside
+    the same frame buffer object before models. Render targets are not multisampled: resolving
+    would average object IDs at edges, so num_multi_samples has no effect on colour image here,
+    supersample should be used for antialiasing instead.
+    @param viewer osg Viewer.
+    @param bg_cam background camera.
+    @param saveImageCallback the callback saving colour images and masks.
+    @param width the int render target width.
+    @param height the int render target height.
+*/
+void ImgGenerator::setupObjectIdRendering(osgViewer::Viewer &viewer, osg::Camera* bg_cam,
+        SaveImageCallback* saveImageCallback, int width, int height) {
+    if (config.getOutput().numMultiSamples > 1) {
+        osg::notify(osg::WARN)<<"num_multi_samples is ignored with id_masks and png/rle mask formats, "
+            <<"colour images are not antialiased unless supersample is set"<<std::endl;
+    }
+    osg::ref_ptr<osg::Image> colorImage = new osg::Image;
+    colorImage->allocateImage(width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, 1);
+    osg::ref_ptr<osg::Image> idImage = new osg::Image;
+    idImage->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, 1);
+
+    osg::Camera* camera = viewer.getCamera();
+    camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    camera->attach(osg::Camera::COLOR_BUFFER0, colorImage.get());
+    camera->attach(osg::Camera::COLOR_BUFFER1, idImage.get());
+    camera->setClearColor(osg::Vec4(0, 0, 0, 0));
+    camera->setClearMask(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+    bg_cam->setRenderOrder(osg::Camera::NESTED_RENDER);
+    bg_cam->setClearMask(0);
+    osg::StateSet* bgStateSet = bg_cam->getOrCreateStateSet();
+    bgStateSet->setRenderBinDetails(-1, "RenderBin");
+    bgStateSet->setAttributeAndModes(createBackgroundIdProgram(), osg::StateAttribute::ON);
+    bgStateSet->addUniform(new osg::Uniform("backgroundTexture", 0));
+
+    objectIdProgram = createObjectIdProgram();
+    whiteTexture = createWhiteTexture();
+    saveImageCallback->setObjectIdImages(colorImage.get(), idImage.get());
+}
+
+/**
+    Assigns object ID to transformation, its models are drawn with object ID program.
+    @param tf the transformation.
+    @param id the 1-based object ID.
+*/
+void ImgGenerator::setObjectId(osg::PositionAttitudeTransform* tf, int id) {
+    osg::StateSet* stateSet = tf->getOrCreateStateSet();
+    stateSet->setAttributeAndModes(objectIdProgram.get(), osg::StateAttribute::ON);
+    stateSet->setTextureAttributeAndModes(0, whiteTexture.get(), osg::StateAttribute::ON);
+    stateSet->addUniform(new osg::Uniform("baseTexture", 0));
+    stateSet->addUniform(new osg::Uniform("objectId", objectIdToUniform(id)));
 }
 
 /**
@@ -222,8 +560,9 @@ class CullCallback : public osg::NodeCallback {
     @return 0 on success, or 1 if error occur
 */
 int ImgGenerator::generateMultipleImages() {
-    std::vector<osg::Image*> bgImages = config.loadBackground();
-    if (bgImages.size() == 0) {
+    osg::ref_ptr<BackgroundCache> bgCache =
+        new BackgroundCache(config, config.bgCacheSize(), config.bgPrefetchCount());
+    if (bgCache->size() == 0) {
         osg::notify(osg::NOTICE)<<"No background images found"<<std::endl;
         return 1;
     }
@@ -234,8 +573,8 @@ int ImgGenerator::generateMultipleImages() {
     }
     osg::Image* maskBgImage = config.loadMaskBackground();
     //check output folder
-    int bgWidth = bgImages[0]->s();
-    int bgHeight = bgImages[0]->t();
+    int bgWidth = config.getOutput().renderWidth;
+    int bgHeight = config.getOutput().renderHeight;
     osg::ref_ptr<osg::Camera> bg_cam = createBackgroundCamera();
     osg::ref_ptr<osg::TextureRectangle> textureRect =
         createBackgroundTexture(bg_cam.get(), bgWidth, bgHeight);
@@ -253,10 +592,26 @@ int ImgGenerator::generateMultipleImages() {
 
     viewer.getCamera()->setClearMask(GL_DEPTH_BUFFER_BIT);
 
-    initTraits(bgWidth, bgHeight, viewer);
+    if (initTraits(bgWidth, bgHeight, viewer) != 0) {
+        return 1;
+    }
 
-    osg::ref_ptr<SaveImageCallback> saveImageCallback = new SaveImageCallback(config.getOutput().width);
+    osg::ref_ptr<SaveImageCallback> saveImageCallback = createSaveImageCallback();
     viewer.getCamera()->setFinalDrawCallback(saveImageCallback.get());
+    //compact masks are derived from object ID image
+    int masks = maskFormat();
+    bool idMasks = config.getOutput().idMasks || masks != SaveImageCallback::MASK_IMAGE;
+    if (idMasks && (int)models.size() > SaveImageCallback::MAX_MASK_OBJECTS) {
+        osg::notify(osg::FATAL)<<"Masks from object IDs support up to "<<SaveImageCallback::MAX_MASK_OBJECTS
+            <<" models, "<<models.size()<<" found"<<std::endl;
+        return 1;
+    }
+    if (idMasks) {
+        setupObjectIdRendering(viewer, bg_cam.get(), saveImageCallback.get(), bgWidth, bgHeight);
+        saveImageCallback->setMaskBackground(maskBgImage);
+        //there is no labels stream in this mode, encoded masks are saved as single-channel images
+        saveImageCallback->setMaskFormat(masks == SaveImageCallback::MASK_RLE ? SaveImageCallback::MASK_GRAY : masks);
+    }
     viewer.realize();
 
     std::vector<osg::ref_ptr<CullCallback> > cullCallbacks;
@@ -286,10 +641,14 @@ int ImgGenerator::generateMultipleImages() {
         osg::ref_ptr<osg::PositionAttitudeTransform> tf = new osg::PositionAttitudeTransform();
         transforms.push_back(tf);
         tf->addChild(model);
+        if (idMasks) {
+            setObjectId(tf.get(), transforms.size());
+        }
         osg::ref_ptr<CullCallback> ccb = new CullCallback();
         tf->setCullCallback(ccb);
         cullCallbacks.push_back(ccb);
     }
+    content += "seed: " + NumberToString(config.randomSeed()) + "\n";
     content += "configuration: \n" + config.getAsString();
     createInfo(folderName, content);
 
@@ -307,14 +666,21 @@ int ImgGenerator::generateMultipleImages() {
         Translation tr = translations[i];
         fileNameWidth += tr.count;
     }
+    int totalImages = fileNameWidth;
     fileNameWidth = getWidth10(fileNameWidth);
     int imgIndex = 1;
-    std::string labels = "file,px,py,pz,ax,ay,az,s\n";
+    //labels of multiple objects are not saved
+    LabelWriter labels;
     for (int i = 0; i < translations.size(); i++) {
         Translation tr = translations[i];
         for (int j = 0; j < tr.count; j++) {
+            if (!isShardImage(imgIndex - 1, totalImages)) {
+                imgIndex++;
+                continue;
+            }
             //random planes hiding
-            int channels = randint(0, 16);
+            randomGenerator.setImage(imgIndex);
+            int channels = randomGenerator.uniformInt(0, 16, RandomGenerator::VISIBILITY_STREAM);
             int groupCount = 0;
             for (int k = 0; k < cullCallbacks.size(); k++) {
                 bool enabled = channels & 1 << k;
@@ -324,43 +690,59 @@ int ImgGenerator::generateMultipleImages() {
                 }
             }
 
-            osg::Vec3d position = getPosition(tr, j);
             std::string fileShortName = intToString(imgIndex, fileNameWidth);
             std::string fileName = folderName + "/" + fileShortName + o.extension;
-            setTranslation(transforms, tr, j, labels, fileShortName, groupCount);
-
-            int bgPos = imgIndex % bgImages.size();
-            osg::Image* bgImage = bgImages[bgPos];
-            generateImage(bgImage, fileName, textureRect, viewer);
-
-            //set no light
-            if (light != NULL) {
-                light->setAmbient(osg::Vec4(0,0,0,1));
-                light->setDiffuse(osg::Vec4(0,0,0,1));
-                light->setSpecular(osg::Vec4(0,0,0,1));
+            setTranslation(transforms, tr, j, labels, fileShortName, imgIndex, groupCount);
+            labels.endRow();
+
+            int bgPos = imgIndex % bgCache->size();
+            osg::ref_ptr<osg::Image> bgImage = bgCache->get(bgPos);
+            if (idMasks) {
+                //all masks are derived from object ID image of single frame
+                unsigned int visible = ~channels & ((1u << transforms.size()) - 1);
+                saveImageCallback->addMaskRequest(o.maskFolder + "/bg_" + fileShortName + "_mask"+ maskExtension(), visible);
+                for (int m = 0; m < transforms.size(); m++) {
+                    std::ostringstream ss;
+                    ss << m;
+                    std::string maskFileName = o.maskFolder + "/" + ss.str() + "_" + fileShortName + "_mask"+ maskExtension();
+                    saveImageCallback->addMaskRequest(maskFileName, visible & (1u << m));
+                }
+                generateImage(bgImage.get(), fileName, textureRect, viewer);
             }
-            std::string maskFileName = o.maskFolder + "/bg_" + fileShortName + "_mask"+ o.extension;
-            generateImage(maskBgImage, maskFileName, textureRect, viewer);
-            for (int m = 0; m < transforms.size(); m++) {
-                for (int k = 0; k < cullCallbacks.size(); k++) {
-                    cullCallbacks[k]->setEnabled(true);
+            else {
+                generateImage(bgImage.get(), fileName, textureRect, viewer);
+
+                //set no light
+                if (light != NULL) {
+                    light->setAmbient(osg::Vec4(0,0,0,1));
+                    light->setDiffuse(osg::Vec4(0,0,0,1));
+                    light->setSpecular(osg::Vec4(0,0,0,1));
                 }
-                cullCallbacks[m]->setEnabled(channels & 1 << m);
-                std::ostringstream ss;
-                ss << m;
-                maskFileName = o.maskFolder + "/" + ss.str() + "_" + fileShortName + "_mask"+ o.extension;
+                std::string maskFileName = o.maskFolder + "/bg_" + fileShortName + "_mask"+ o.extension;
                 generateImage(maskBgImage, maskFileName, textureRect, viewer);
-            }
-            //restore to initial light
-            if (light != NULL) {
-                light->setAmbient(ambient);
-                light->setDiffuse(diffuse);
-                light->setSpecular(specular);
+                for (int m = 0; m < transforms.size(); m++) {
+                    for (int k = 0; k < cullCallbacks.size(); k++) {
+                        cullCallbacks[k]->setEnabled(true);
+                    }
+                    cullCallbacks[m]->setEnabled(channels & 1 << m);
+                    std::ostringstream ss;
+                    ss << m;
+                    maskFileName = o.maskFolder + "/" + ss.str() + "_" + fileShortName + "_mask"+ o.extension;
+                    generateImage(maskBgImage, maskFileName, textureRect, viewer);
+                }
+                //restore to initial light
+                if (light != NULL) {
+                    light->setAmbient(ambient);
+                    light->setDiffuse(diffuse);
+                    light->setSpecular(specular);
+                }
             }
 
             imgIndex++;
         }
     }
+    flushImages(viewer);
+    writePerformanceReport();
     return 0;
 }
 
@@ -369,8 +751,9 @@ int ImgGenerator::generateMultipleImages() {
     @return 0 on success, or 1 if error occur
 */
 int ImgGenerator::generateImages() {
-    std::vector<osg::Image*> bgImages = config.loadBackground();
-    if (bgImages.size() == 0) {
+    osg::ref_ptr<BackgroundCache> bgCache =
+        new BackgroundCache(config, config.bgCacheSize(), config.bgPrefetchCount());
+    if (bgCache->size() == 0) {
         osg::notify(osg::NOTICE)<<"No background images found"<<std::endl;
         return 1;
     }
@@ -379,13 +762,123 @@ int ImgGenerator::generateImages() {
         osg::notify(osg::NOTICE)<<"No models found"<<std::endl;
         return 1;
     }
-    osg::Image* maskBgImage;
+    osg::ref_ptr<osg::Image> maskBgImage;
     if (mode == 3) {
         maskBgImage = config.loadMaskBackground();
     }
-    //check output folder
-    int bgWidth = bgImages[0]->s();
-    int bgHeight = bgImages[0]->t();
+    int contexts = config.getOutput().renderContexts;
+    int result;
+    if (contexts > 1 && (mode == 1 || mode == 3)) {
+        result = renderConcurrently(models, bgCache.get(), maskBgImage.get(), contexts);
+    }
+    else {
+        result = renderImages(models, bgCache.get(), maskBgImage.get(), false);
+    }
+    //labels fragments of other processes are joined by '-merge'
+    if ((mode == 1 || mode == 3) && shardCount == 1 && result == 0) {
+        result = mergeLabels(1);
+    }
+    writePerformanceReport();
+    return result;
+}
+
+/**
+    Prints time spent in generation stages by all threads of process, and writes
+    it to 'performance-i-of-N.json' of output folder when images are saved.
+*/
+void ImgGenerator::writePerformanceReport() {
+    Profiler* profiler = Profiler::instance();
+    profiler->print(std::cout);
+    Output o = config.getOutput();
+    if (mode != 0 && dirExists(o.folder)) {
+        std::ostringstream fileName;
+        fileName << o.folder << "/performance-" << shardIndex << "-of-" << shardCount << ".json";
+        if (!profiler->writeJson(fileName.str())) {
+            osg::notify(osg::WARN)<<"Performance report '"<<fileName.str()<<"' can not be written"<<std::endl;
+        }
+    }
+}
+
+/**
+    Generates images on specified count of worker threads, each owns its own graphics context
+    and renders contiguous subrange of image indices of this process, so it writes its own labels
+    fragment and manifest. Models and background images are shared by all contexts.
+    @param models the loaded models.
+    @param bgCache the background images.
+    @param maskBgImage the background of masks, can be NULL.
+    @param contexts the int count of graphics contexts.
+    @return 0 on success, or 1 if error occur
+*/
+int ImgGenerator::renderConcurrently(const std::map<std::string, osg::Node*> &models, BackgroundCache* bgCache,
+        osg::Image* maskBgImage, int contexts) {
+    //GL objects of shared models are kept per context
+    osg::DisplaySettings* settings = osg::DisplaySettings::instance().get();
+    if (settings->getMaxNumberOfGraphicsContexts() < contexts + 1) {
+        settings->setMaxNumberOfGraphicsContexts(contexts + 1);
+    }
+    //bounds are computed lazily, so they are computed before models are shared
+    for (std::map<std::string, osg::Node*>::const_iterator it = models.begin(); it != models.end(); ++it) {
+        it->second->getBound();
+    }
+    std::vector<RenderThread*> threads;
+    for (int i = 0; i < contexts; i++) {
+        ImgGenerator* worker = new ImgGenerator(config);
+        worker->setMode(mode);
+        worker->setShard(shardIndex * contexts + i, shardCount * contexts);
+        worker->setResume(resume);
+        threads.push_back(new RenderThread(worker, &models, bgCache, maskBgImage));
+        threads.back()->start();
+    }
+    int result = 0;
+    for (int i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+        result |= threads[i]->result;
+        delete threads[i];
+    }
+    int folderNameWidth = getFolderWidth10(models.size());
+    int k = 0;
+    for (std::map<std::string, osg::Node*>::const_iterator it = models.begin(); it != models.end(); ++it, k++) {
+        std::string folderName = config.getOutput().folder + "/" + intToString(k, folderNameWidth);
+        if (!dirExists(folderName)) {
+            makeDir(folderName);
+        }
+        std::string content = "model :" + it->first + "\n";
+        content += "seed: " + NumberToString(config.randomSeed()) + "\n";
+        content += "configuration: \n" + config.getAsString();
+        createInfo(folderName, content);
+    }
+    return result;
+}
+
+/**
+    Releases scene of viewer and background image, shared models and images
+    are detached under lock.
+    @param viewer osg Viewer.
+    @param textureRect the background texture.
+    @param transforms the transformations of current model.
+*/
+void ImgGenerator::releaseScene(osgViewer::Viewer &viewer, osg::TextureRectangle* textureRect,
+        std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(sharedSceneMutex);
+    textureRect->setImage(NULL);
+    transforms.clear();
+    viewer.setSceneData(NULL);
+}
+
+/**
+    Renders images of current shard for all models. In modes 1 and 3 label rows are written
+    to labels fragment of shard and progress is committed to manifest of shard every
+    checkpoint_interval seconds and after each model. On resume committed images are skipped.
+    @param models the loaded models.
+    @param bgCache the background images.
+    @param maskBgImage the background of masks, used in mode 3.
+    @param worker true if called by render thread, info files are written by caller then.
+    @return 0 on success, or 1 if error occur
+*/
+int ImgGenerator::renderImages(const std::map<std::string, osg::Node*> &models, BackgroundCache* bgCache,
+        osg::Image* maskBgImage, bool worker) {
+    int bgWidth = config.getOutput().renderWidth;
+    int bgHeight = config.getOutput().renderHeight;
 
     osg::ref_ptr<osg::Camera> bg_cam = createBackgroundCamera();
     osg::ref_ptr<osg::TextureRectangle> textureRect =
@@ -393,6 +886,10 @@ int ImgGenerator::generateImages() {
     //multisamles antialiasing
     osg::DisplaySettings::instance()->setNumMultiSamples(config.getOutput().numMultiSamples);
     osgViewer::Viewer viewer;
+    if (worker) {
+        //worker thread draws its context itself
+        viewer.setThreadingModel(osgViewer::ViewerBase::SingleThreaded);
+    }
     osg::ref_ptr<osg::Group> root = new osg::Group();
     osg::ref_ptr<osg::PositionAttitudeTransform> oldModelTf = new osg::PositionAttitudeTransform();
     root->addChild(oldModelTf);
@@ -402,30 +899,30 @@ int ImgGenerator::generateImages() {
     viewer.setCameraManipulator(new osgGA::TrackballManipulator);
 
     viewer.getCamera()->setClearMask(GL_DEPTH_BUFFER_BIT);
-    int xoffset = 0;
-    int yoffset = 0;
-    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
-    traits->x = xoffset + 0;
-    traits->y = yoffset + 0;
-    traits->width = bgWidth;
-    traits->height = bgHeight;
-    std::cout << "traits: " << traits->x << ", "<<traits->y <<", "<<traits->width<<", "<<traits->height<< std::endl;
-    traits->windowDecoration = true;
-    traits->doubleBuffer = true;
-    traits->sharedContext = 0;
-    traits->samples = config.getOutput().numMultiSamples;
 
-    osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
-    viewer.getCamera()->setGraphicsContext(gc.get());
-    viewer.getCamera()->setViewport(new osg::Viewport(0,0, traits->width, traits->height));
-    GLenum buffer = traits->doubleBuffer ? GL_BACK : GL_FRONT;
-    viewer.getCamera()->setDrawBuffer(buffer);
-    viewer.getCamera()->setReadBuffer(buffer);
+    if (initTraits(bgWidth, bgHeight, viewer) != 0) {
+        return 1;
+    }
 
+    osg::ref_ptr<SaveImageCallback> saveImageCallback;
     if (mode == 1 || mode == 3) {
-        osg::ref_ptr<SaveImageCallback> saveImageCallback = new SaveImageCallback(config.getOutput().width);
+        saveImageCallback = createSaveImageCallback();
         viewer.getCamera()->setFinalDrawCallback(saveImageCallback.get());
     }
+    //compact masks are derived from object ID image, encoded masks are appended to labels rows
+    int masks = maskFormat();
+    bool idMasks = mode == 3 && (config.getOutput().idMasks || masks != SaveImageCallback::MASK_IMAGE);
+    bool rleMasks = masks == SaveImageCallback::MASK_RLE && saveImageCallback.valid();
+    if (idMasks && config.getOutput().numObjects > SaveImageCallback::MAX_MASK_OBJECTS) {
+        osg::notify(osg::FATAL)<<"Masks from object IDs support up to "<<SaveImageCallback::MAX_MASK_OBJECTS
+            <<" objects, num_objects is "<<config.getOutput().numObjects<<std::endl;
+        return 1;
+    }
+    if (idMasks) {
+        setupObjectIdRendering(viewer, bg_cam.get(), saveImageCallback.get(), bgWidth, bgHeight);
+        saveImageCallback->setMaskBackground(maskBgImage);
+        saveImageCallback->setMaskFormat(masks);
+    }
 
     viewer.realize();
 
@@ -436,8 +933,22 @@ int ImgGenerator::generateImages() {
     int imgIdx = 1;
     std::vector<Translation> translations = config.getTranslations();
     std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > transforms;
+    bool instancing = o.instancing && o.numObjects > 1;
+    if (instancing && o.numObjects > InstancedModel::MAX_INSTANCES) {
+        osg::notify(osg::NOTICE)<<"Instancing supports up to "<<InstancedModel::MAX_INSTANCES
+            <<" objects, separate transformations used"<<std::endl;
+        instancing = false;
+    }
+    if (instancing && !whiteTexture.valid()) {
+        whiteTexture = createWhiteTexture();
+    }
 
     int folderNameWidth = getFolderWidth10(models.size());
+    int imagesPerModel = 0;
+    for (int i = 0; i < translations.size(); i++) {
+        imagesPerModel += translations[i].count;
+    }
+    int totalImages = imagesPerModel * models.size();
     osg::Vec4 ambient = osg::Vec4(0,0,0,1);
     osg::Vec4 diffuse = osg::Vec4(0.8,0.8,0.8,1);
     osg::Vec4 specular = osg::Vec4(1,1,1,1);
@@ -452,29 +963,61 @@ int ImgGenerator::generateImages() {
             makeDir(o.maskFolder);
         }
     }
+    osg::ref_ptr<Checkpoint> checkpoint;
+    if (mode == 1 || mode == 3) {
+        if (!dirExists(o.folder)) {
+            makeDir(o.folder);
+        }
+        std::ostringstream manifestName;
+        manifestName << o.folder << "/progress-" << shardIndex << "-of-" << shardCount << ".txt";
+        checkpoint = new Checkpoint(manifestName.str(), resume, o.checkpointInterval);
+    }
     int k = 0;
-    for (std::map<std::string, osg::Node*>::iterator it=models.begin(); it!=models.end(); ++it) {
+    for (std::map<std::string, osg::Node*>::const_iterator it=models.begin(); it!=models.end(); ++it) {
         Output o = config.getOutput();
         std::string folderName = o.folder + "/" + intToString(k, folderNameWidth);
         if (mode == 1 || mode == 3) {
             if (!dirExists(folderName)) {
                 makeDir(folderName);
             }
-            std::string content = "model :" + it->first + "\n";
-            content += "configuration: \n" + config.getAsString();
-            createInfo(folderName, content);
+            if (!worker) {
+                std::string content = "model :" + it->first + "\n";
+                content += "seed: " + NumberToString(config.randomSeed()) + "\n";
+                content += "configuration: \n" + config.getAsString();
+                createInfo(folderName, content);
+            }
         }
         osg::Node* newModel = it->second;
+        //parent lists of shared model are modified, scene of other context can be replaced at the same time
+        sharedSceneMutex.lock();
         osg::ref_ptr<osg::Group> newRoot = new osg::Group();
+        //instanced copy of model, transformations only hold instance placement
+        osg::ref_ptr<InstancedModel> instanced;
+        if (instancing) {
+            instanced = new InstancedModel(newModel, o.numObjects, idMasks, whiteTexture.get());
+            newRoot->addChild(instanced->getNode());
+        }
         transforms.clear();
         for (int i = 0; i < config.getOutput().numObjects; i++) {
             osg::ref_ptr<osg::PositionAttitudeTransform> tf = new osg::PositionAttitudeTransform();
             transforms.push_back(tf);
+            if (instancing) {
+                continue;
+            }
             tf->addChild(newModel);
+            if (idMasks) {
+                setObjectId(tf.get(), i + 1);
+            }
             newRoot->addChild(tf);
         }
         newRoot->addChild(bg_cam.get());
         viewer.setSceneData(newRoot);
+        sharedSceneMutex.unlock();
+        //boxes are computed from model vertices, so mask frames are not needed for them
+        osg::ref_ptr<Annotator> annotator;
+        if (o.annotations && checkpoint.valid()) {
+            annotator = new Annotator(newModel, o.keypoints);
+        }
         int modelImgIndex = 1;
         int fileNameWidth = 0;
         for (int i = 0; i < translations.size(); i++) {
@@ -482,35 +1025,70 @@ int ImgGenerator::generateImages() {
             fileNameWidth += tr.count;
         }
         fileNameWidth = getWidth10(fileNameWidth);
-        std::string labels = "file,px,py,pz,ax,ay,az,s\n";
+        //rows are streamed to labels fragment, or discarded if images are not saved
+        LabelWriter discardedLabels;
+        LabelWriter &labels = checkpoint.valid() ? checkpoint->getLabels() : discardedLabels;
+        //label row of image is also streamed or packed next to image
+        ShardWriter* shards = saveImageCallback.valid() ? saveImageCallback->getImageWriter()->getShardWriter() : NULL;
+        FrameRing* ring = saveImageCallback.valid() ? saveImageCallback->getImageWriter()->getFrameRing() : NULL;
+        labels.setKeepLastRow(shards != NULL || ring != NULL);
+        if (checkpoint.valid() && !hasShardImages(imgIdx - 1, imagesPerModel, totalImages)) {
+            //merge expects fragments of all shards in every folder, so folder out of range gets empty ones
+            createEmptyFragment(folderName + "/" + labelsFragmentName(shardIndex, shardCount));
+            if (o.binaryLabels) {
+                createEmptyFragment(folderName + "/" + labelsFragmentName(shardIndex, shardCount, true));
+            }
+        }
+        int lastImgIdx = 0;
         for (int i = 0; i < translations.size(); i++) {
             Translation tr = translations[i];
             for (int j = 0; j < tr.count; j++) {
-                osg::Vec3d position = getPosition(tr, j);
+                if (!isShardImage(imgIdx - 1, totalImages) || (checkpoint.valid() && checkpoint->isDone(imgIdx))) {
+                    modelImgIndex++;
+                    imgIdx++;
+                    continue;
+                }
+                if (checkpoint.valid() && lastImgIdx == 0) {
+                    checkpoint->setFragment(folderName + "/" + labelsFragmentName(shardIndex, shardCount),
+                        o.binaryLabels ? folderName + "/" + labelsFragmentName(shardIndex, shardCount, true) : "");
+                }
+                //all draws of image depend only on seed and global image index
+                randomGenerator.setImage(imgIdx);
                 std::string fileShortName = intToString(modelImgIndex, fileNameWidth);
                 std::string fileName = folderName + "/" + fileShortName + o.extension;
-                setTranslation(transforms, tr, j, labels, fileShortName, transforms.size());
+                setTranslation(transforms, tr, j, labels, fileShortName, modelImgIndex, transforms.size());
+                if (instanced.valid()) {
+                    instanced->setInstanceMatrices(transforms);
+                }
+                if (annotator.valid()) {
+                    annotateImage(annotator.get(), viewer, transforms, labels);
+                }
 
-                int bgPos = imgIdx % bgImages.size();
-                osg::Image* bgImage = bgImages[bgPos];
-                generateImage(bgImage, fileName, textureRect, viewer);
+                int bgPos = imgIdx % bgCache->size();
+                osg::ref_ptr<osg::Image> bgImage = bgCache->get(bgPos);
+                std::string maskFileName;
                 if (mode == 3) {
-                    //set no light
-                    if (light != NULL) {
-                        light->setAmbient(osg::Vec4(0,0,0,1));
-                        light->setDiffuse(osg::Vec4(0,0,0,1));
-                        light->setSpecular(osg::Vec4(0,0,0,1));
-                    }
-                    std::string maskFileName;
                     if (models.size() > 1) {
                         std::ostringstream ss;
                         ss << k;
-                        maskFileName = o.maskFolder + "/" + ss.str() + "_" + fileShortName + "_mask"+ o.extension;
+                        maskFileName = o.maskFolder + "/" + ss.str() + "_" + fileShortName + "_mask"+ maskExtension();
                     }
                     else {
-                        maskFileName = o.maskFolder + "/" + fileShortName + "_mask"+ o.extension;
+                        maskFileName = o.maskFolder + "/" + fileShortName + "_mask"+ maskExtension();
+                    }
+                }
+                if (idMasks) {
+                    //mask of all objects is derived from object ID image of the same frame
+                    saveImageCallback->addMaskRequest(maskFileName, ~0u);
+                }
+                generateImage(bgImage.get(), fileName, textureRect, viewer);
+                if (mode == 3 && !idMasks) {
+                    //set no light
+                    if (light != NULL) {
+                        light->setAmbient(osg::Vec4(0,0,0,1));
+                        light->setDiffuse(osg::Vec4(0,0,0,1));
+                        light->setSpecular(osg::Vec4(0,0,0,1));
                     }
-
                     generateImage(maskBgImage, maskFileName, textureRect, viewer);
                     //restore to initial light
                     if (light != NULL) {
@@ -519,61 +1097,67 @@ int ImgGenerator::generateImages() {
                         light->setSpecular(specular);
                     }
                 }
+                if (rleMasks) {
+                    std::vector<std::string> encoded = saveImageCallback->takeEncodedMasks();
+                    labels.addText(encoded.empty() ? "" : encoded[0]);
+                }
+                labels.endRow();
+                if (ring) {
+                    const std::string &row = labels.getLastRow();
+                    ring->publish(FrameRing::LABELS, FrameRing::TEXT, fileName, row.data(), row.size());
+                }
+                else if (shards) {
+                    shards->append(folderName + "/" + fileShortName + ".csv", labels.getLastRow());
+                }
+                lastImgIdx = imgIdx;
                 if (viewer.done()) {
-                    return 0;
+                    flushImages(viewer);
+                    if (checkpoint.valid()) {
+                        checkpoint->commit(lastImgIdx);
+                    }
+                    releaseScene(viewer, textureRect.get(), transforms);
+                    //interrupted generation is continued by -resume
+                    return 1;
+                }
+                if (checkpoint.valid() && checkpoint->isDue()) {
+                    //images up to the committed one are saved before manifest is written
+                    flushImages(viewer);
+                    checkpoint->commit(lastImgIdx);
                 }
                 modelImgIndex++;
                 imgIdx++;
             }
         }
-        if (mode == 1 || mode == 3) {
-            createLabels(folderName, labels);
+        if (checkpoint.valid() && lastImgIdx > 0) {
+            flushImages(viewer);
+            checkpoint->commit(lastImgIdx);
         }
         k++;
     }
+    flushImages(viewer);
+    releaseScene(viewer, textureRect.get(), transforms);
     return 0;
 }
 
-/**
-    Sets position, attitude and scale of transformation using specified Translation object.
-    Also appends current transformation values to 'labels' string;
-    @param modelTf the transformation.
-    @param tr the Translation.
-    @param j the int specified current counter of calculations.
-    @param labels the list of generated image names with correspondent transformation values.
-    @param fileShortName the file name of generated image.
-*/
-void ImgGenerator::setTranslation(osg::ref_ptr<osg::PositionAttitudeTransform> modelTf, Translation tr, int j,
-            std::string &labels, std::string fileShortName) {
-    osg::Vec3d position = getPosition(tr, j);
-    modelTf->setPosition( position );
-    osg::Vec3d angles = getRotation(tr, j);
-    osg::Quat rot(angles.x(), osg::X_AXIS, angles.y(), osg::Y_AXIS, angles.z(), osg::Z_AXIS);
-    modelTf->setAttitude(rot);
-    osg::Vec3d vScale = getScale(tr, j);
-    modelTf->setScale(vScale);
-    labels.append(fileShortName).append(",").
-                    append(NumberToString(position.x())).append(",").
-                    append(NumberToString(position.y())).append(",").
-                    append(NumberToString(position.z())).append(",").
-                    append(NumberToString(angles.x())).append(",").
-                    append(NumberToString(angles.y())).append(",").
-                    append(NumberToString(angles.z())).append(",").
-                    append(NumberToString(vScale.x())).append("\n");
+//Thread body, renders images of worker range.
+void ImgGenerator::RenderThread::run() {
+    result = generator->renderImages(*models, bgCache, maskBgImage, true);
 }
 
 /**
     Sets position, attitude and scale of transformations using specified Translation object.
-    Also appends current transformation values to 'labels' string;
+    Also begins row of labels with current transformation values, caller ends row;
     @param transforms the list of transformations.
     @param tr the Translation.
     @param j the int specified current counter of calculations.
-    @param labels the list of generated image names with correspondent transformation values.
+    @param labels the writer of generated image names with correspondent transformation values.
     @param fileShortName the file name of generated image.
+    @param fileIndex the int number of generated image in its folder.
     @param groupCount count of transformations in group, in range 1..4.
 */
 void ImgGenerator::setTranslation(std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > transforms, Translation tr, int j,
-            std::string &labels, std::string fileShortName, int groupCount) {
+            LabelWriter &labels, std::string fileShortName, int fileIndex, int groupCount) {
+    StageTimer timer(Profiler::SET_TRANSLATION);
     osg::Vec3d position = getPosition(tr, j);
     setGroupShift(transforms, position, groupCount);
     osg::Vec3d angles = getRotation(tr, j);
@@ -583,14 +1167,45 @@ void ImgGenerator::setTranslation(std::vector<osg::ref_ptr<osg::PositionAttitude
         transforms[i]->setAttitude(rot);
         transforms[i]->setScale(vScale);
     }
-    labels.append(fileShortName).append(",").
-                    append(NumberToString(position.x())).append(",").
-                    append(NumberToString(position.y())).append(",").
-                    append(NumberToString(position.z())).append(",").
-                    append(NumberToString(angles.x())).append(",").
-                    append(NumberToString(angles.y())).append(",").
-                    append(NumberToString(angles.z())).append(",").
-                    append(NumberToString(vScale.x())).append("\n");
+    labels.beginRow(fileShortName, fileIndex);
+    labels.addNumber(position.x());
+    labels.addNumber(position.y());
+    labels.addNumber(position.z());
+    labels.addNumber(angles.x());
+    labels.addNumber(angles.y());
+    labels.addNumber(angles.z());
+    labels.addNumber(vScale.x());
+    //binary record also holds shifted position of every object of multi-object scene
+    if (transforms.size() > 1) {
+        for (int i = 0; i < transforms.size(); i++) {
+            osg::Vec3d objectPosition = transforms[i]->getPosition();
+            labels.addBinaryNumber(objectPosition.x());
+            labels.addBinaryNumber(objectPosition.y());
+            labels.addBinaryNumber(objectPosition.z());
+        }
+    }
+}
+
+/**
+    Appends annotations of objects, projected by current camera matrices, to current row of labels.
+    Coordinates are pixels of saved image, which is scaled to output width.
+    @param annotator the annotator of current model.
+    @param viewer osg Viewer.
+    @param transforms the transformations of objects.
+    @param labels the writer of labels row.
+*/
+void ImgGenerator::annotateImage(Annotator* annotator, osgViewer::Viewer &viewer,
+        std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms, LabelWriter &labels) {
+    osg::Camera* camera = viewer.getCamera();
+    osg::Viewport* viewport = camera->getViewport();
+    double width = config.getOutput().width;
+    double height = (int)(width * viewport->height() / viewport->width());
+    osg::ref_ptr<osg::Viewport> output = new osg::Viewport(0, 0, width, height);
+    //view matrix is applied to camera from manipulator during next frame
+    osg::Matrixd view = viewer.getCameraManipulator() ? viewer.getCameraManipulator()->getInverseMatrix()
+        : camera->getViewMatrix();
+    osg::Matrixd viewProjection = view * camera->getProjectionMatrix() * output->computeWindowMatrix();
+    annotator->annotate(transforms, viewProjection, width, height, labels);
 }
 
 /**
@@ -602,32 +1217,18 @@ void ImgGenerator::setTranslation(std::vector<osg::ref_ptr<osg::PositionAttitude
 */
 void ImgGenerator::generateImage(osg::Image* image, std::string fileName,
     osg::ref_ptr<osg::TextureRectangle> &textureRect, osgViewer::Viewer &viewer) {
-    osg::ref_ptr<osg::Image> clone = osg::clone( image, osg::CopyOp::DEEP_COPY_ALL );
-    if (config.bgAugmentation()) {
-        double hFlip = (double)rand() / RAND_MAX;
-        double vFlip = (double)rand() / RAND_MAX;
-        double hSize = (double)rand() / RAND_MAX + 1.0;
-        double vSize = (double)rand() / RAND_MAX + 1.0;
-        double s = (double)(clone->s());
-        double t = (double)clone->t();
-
-        clone->scaleImage((int)(clone->s() * hSize), (int)(clone->t() * vSize), clone->r());
-
-        double sZero = 0.0;
-        double tZero = 0.0;
-        osg::Image* cropped = cropImage(clone, 0.0, 0.0, (double)clone->s(), (double)clone->t(), sZero, tZero, s, t );
-        if (hFlip > 0.5) {
-            cropped->flipHorizontal();
-        }
-        if (vFlip > 0.5) {
-            cropped->flipVertical();
-        }
-        cropped->dirty();
-        textureRect->setImage(cropped);
+    osg::Image* bgImage = image;
+    if (config.bgAugmentation() && config.gpuBgAugmentation()) {
+        augmentBackgroundTexture(image->s(), image->t());
     }
-    else {
-        clone->dirty();
-        textureRect->setImage(clone.get());
+    else if (config.bgAugmentation()) {
+        bgImage = augmentBackground(image);
+    }
+    //texture uploads image again only if it is rebound or dirty
+    if (textureRect->getImage() != bgImage) {
+        //image can be bound to textures of other contexts
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(sharedSceneMutex);
+        textureRect->setImage(bgImage);
     }
     osg::ref_ptr<SaveImageCallback> saveImageCallback =
         dynamic_cast<SaveImageCallback*>(viewer.getCamera()->getFinalDrawCallback());
@@ -635,21 +1236,56 @@ void ImgGenerator::generateImage(osg::Image* image, std::string fileName,
         saveImageCallback->setFinished(false);
         saveImageCallback->setFileName(fileName);
     }
-    viewer.frame();
+    {
+        StageTimer timer(Profiler::FRAME);
+        viewer.frame();
+    }
+    StageTimer timer(Profiler::WAIT);
     if (mode == 0) {
         usleep(300000);
     }
     else {
-        if(saveImageCallback.get()) {
-            int maxDelay = 0;
-            while (!saveImageCallback.get()->isFinished() && maxDelay < 100) {
-                usleep(30000);
-                maxDelay++;
-            }
+        waitImageSaved(saveImageCallback.get());
+    }
+}
+
+/**
+    Waits until SaveImageCallback finishes processing of the current frame.
+    @param saveImageCallback the callback, can be NULL.
+*/
+void ImgGenerator::waitImageSaved(SaveImageCallback* saveImageCallback) {
+    if(saveImageCallback) {
+        if (!saveImageCallback->waitFinished(3000)) {
+            osg::notify(osg::WARN)<<"Image is not saved in 3 seconds"<<std::endl;
         }
     }
 }
 
+/**
+    Saves frames still pending in asynchronous readback ring of SaveImageCallback,
+    then waits until writer threads save all queued images.
+    An extra frame is drawn with empty file name, so no new image is read.
+    @param viewer osg Viewer.
+*/
+void ImgGenerator::flushImages(osgViewer::Viewer &viewer) {
+    osg::ref_ptr<SaveImageCallback> saveImageCallback =
+        dynamic_cast<SaveImageCallback*>(viewer.getCamera()->getFinalDrawCallback());
+    if(!saveImageCallback.get()) {
+        return;
+    }
+    if(saveImageCallback->isAsync()) {
+        saveImageCallback->setFinished(false);
+        saveImageCallback->setFileName("");
+        {
+            StageTimer timer(Profiler::FRAME);
+            viewer.frame();
+        }
+        StageTimer timer(Profiler::WAIT);
+        waitImageSaved(saveImageCallback.get());
+    }
+    saveImageCallback->getImageWriter()->flush();
+}
+
 /**
     Generates vector of new object position according to specified translation
     @param tr the Translation.
@@ -659,9 +1295,9 @@ void ImgGenerator::generateImage(osg::Image* image, std::string fileName,
 osg::Vec3d ImgGenerator::getPosition(Translation tr, int j) {
     double xShift, yShift, zShift;
     if (tr.random) {
-        xShift = getRand(tr.position.x_from, tr.position.x_to);
-        yShift = getRand(tr.position.y_from, tr.position.y_to);
-        zShift = getRand(tr.position.z_from, tr.position.z_to);
+        xShift = getRand(tr.position.x_from, tr.position.x_to, RandomGenerator::POSE_STREAM);
+        yShift = getRand(tr.position.y_from, tr.position.y_to, RandomGenerator::POSE_STREAM);
+        zShift = getRand(tr.position.z_from, tr.position.z_to, RandomGenerator::POSE_STREAM);
     }
     else {
         xShift = tr.position.x_from + tr.position.x_delta * j;
@@ -681,9 +1317,9 @@ osg::Vec3d ImgGenerator::getPosition(Translation tr, int j) {
 osg::Vec3d ImgGenerator::getRotation(Translation tr, int j) {
     double xAngle, yAngle, zAngle;
     if (tr.random) {
-        xAngle = getRand(tr.angle.x_from, tr.angle.x_to);
-        yAngle = getRand(tr.angle.y_from, tr.angle.y_to);
-        zAngle = getRand(tr.angle.z_from, tr.angle.z_to);
+        xAngle = getRand(tr.angle.x_from, tr.angle.x_to, RandomGenerator::POSE_STREAM);
+        yAngle = getRand(tr.angle.y_from, tr.angle.y_to, RandomGenerator::POSE_STREAM);
+        zAngle = getRand(tr.angle.z_from, tr.angle.z_to, RandomGenerator::POSE_STREAM);
     }
     else {
         xAngle = tr.angle.x_from + tr.angle.x_delta * j;
@@ -703,7 +1339,7 @@ osg::Vec3d ImgGenerator::getRotation(Translation tr, int j) {
 osg::Vec3d ImgGenerator::getScale(Translation tr, int j) {
     double scale;
     if (tr.random) {
-        scale = getRand(tr.scale_from, tr.scale_to);
+        scale = getRand(tr.scale_from, tr.scale_to, RandomGenerator::POSE_STREAM);
     }
     else {
         scale = tr.scale_from + tr.scale_delta * j;
@@ -713,85 +1349,78 @@ osg::Vec3d ImgGenerator::getScale(Translation tr, int j) {
 }
 
 /**
-    Returns a pseudo-random double between specified from and to values.
+    Returns a pseudo-random double between specified from and to values, drawn for current image.
     @param from the double minimal range value.
     @param to the double maximal range value.
+    @param stream the stream of draws, RandomGenerator::Stream.
     @return a pseudo-random double between specified from and to values.
 */
-double ImgGenerator::getRand(double from, double to) {
-    double f = (double)rand() / RAND_MAX;
-    return from + f * (to - from);
-}
-
-/**
-    Returns new image cropped using specified parameters.
-    src_ values defines source image window, dst_ values - destination image window
-    @param image initial image.
-    @param src_minx the double minimal source x position.
-    @param src_miny the double minimal source y position.
-    @param src_maxx the double maximal source x position.
-    @param src_maxy the double maximal source y position.
-    @param dst_minx the double minimal destination x position.
-    @param dst_miny the double minimal destination y position.
-    @param dst_maxx the double maximal destination x position.
-    @param dst_maxy the double maximal destination y position.
-    @return a new cropped image.
-*/
-osg::Image* ImgGenerator::cropImage(const osg::Image* image,
-                      double src_minx, double src_miny, double src_maxx, double src_maxy,
-                      double &dst_minx, double &dst_miny, double &dst_maxx, double &dst_maxy)
-{
-    if ( image == 0L )
-        return 0L;
-
-    //Compute the desired cropping rectangle
-    int windowX        = osg::clampBetween( (int)floor( (dst_minx - src_minx) / (src_maxx - src_minx) * (double)image->s()), 0, image->s()-1);
-    int windowY        = osg::clampBetween( (int)floor( (dst_miny - src_miny) / (src_maxy - src_miny) * (double)image->t()), 0, image->t()-1);
-    int windowWidth    = osg::clampBetween( (int)ceil(  (dst_maxx - src_minx) / (src_maxx - src_minx) * (double)image->s()) - windowX, 0, image->s());
-    int windowHeight   = osg::clampBetween( (int)ceil(  (dst_maxy - src_miny) / (src_maxy - src_miny) * (double)image->t()) - windowY, 0, image->t());
-
-    if (windowX + windowWidth > image->s())
-    {
-        windowWidth = image->s() - windowX;
-    }
+double ImgGenerator::getRand(double from, double to, int stream) {
+    return randomGenerator.uniform(from, to, stream);
+}
 
-    if (windowY + windowHeight > image->t())
-    {
-        windowHeight = image->t() - windowY;
+/**
+    Applies random zoom and flips to background by texture matrix, so background image stays
+    resident on GPU. Rectangle texture coords are in pixels, the matrix maps the quad to
+    subregion starting at origin, the same as CPU augmentation does.
+    @param width the int background image width.
+    @param height the int background image height.
+*/
+void ImgGenerator::augmentBackgroundTexture(int width, int height) {
+    double hFlip = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM);
+    double vFlip = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM);
+    double hSize = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM) + 1.0;
+    double vSize = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM) + 1.0;
+    double scaleS = 1.0 / hSize;
+    double scaleT = 1.0 / vSize;
+    double offsetS = 0.0;
+    double offsetT = 0.0;
+    if (hFlip > 0.5) {
+        offsetS = width * scaleS;
+        scaleS = -scaleS;
     }
-
-    if ((windowWidth * windowHeight) == 0)
-    {
-        return NULL;
+    if (vFlip > 0.5) {
+        offsetT = height * scaleT;
+        scaleT = -scaleT;
     }
+    bgTexMat->setMatrix(osg::Matrix::scale(scaleS, scaleT, 1.0) * osg::Matrix::translate(offsetS, offsetT, 0.0));
+}
 
-    //Compute the actual bounds of the area we are computing
-    double res_s = (src_maxx - src_minx) / (double)image->s();
-    double res_t = (src_maxy - src_miny) / (double)image->t();
-
-    dst_minx = src_minx + (double)windowX * res_s;
-    dst_miny = src_miny + (double)windowY * res_t;
-    dst_maxx = dst_minx + (double)windowWidth * res_s;
-    dst_maxy = dst_miny + (double)windowHeight * res_t;
-
-    //Allocate the cropped image
-    osg::Image* cropped = new osg::Image;
-    cropped->allocateImage(windowWidth, windowHeight, image->r(), image->getPixelFormat(), image->getDataType());
-    cropped->setInternalTextureFormat( image->getInternalTextureFormat() );
-
-    for (int layer=0; layer<image->r(); ++layer)
-    {
-        for (int src_row = windowY, dst_row=0; dst_row < windowHeight; src_row++, dst_row++)
-        {
-            if (src_row > image->t()-1) {
-                osg::notify(osg::NOTICE) << "HeightBroke" << std::endl;
-            }
-            const void* src_data = image->data(windowX, src_row, layer);
-            void* dst_data = cropped->data(0, dst_row, layer);
-            memcpy( dst_data, src_data, cropped->getRowSizeInBytes());
-        }
+/**
+    Applies random zoom and flips to background image. Result is written to scratch image,
+    which is reused between frames, source image is not modified.
+    @param image the background image.
+    @return augmented image.
+*/
+osg::Image* ImgGenerator::augmentBackground(osg::Image* image) {
+    double hFlip = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM);
+    double vFlip = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM);
+    double hSize = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM) + 1.0;
+    double vSize = randomGenerator.uniform(RandomGenerator::BACKGROUND_STREAM) + 1.0;
+    int channels = osg::Image::computeNumComponents(image->getPixelFormat());
+    if (image->getDataType() != GL_UNSIGNED_BYTE || channels < 1 || channels > 4) {
+        osg::notify(osg::WARN) << "Background augmentation supports only 8-bit images." << std::endl;
+        return image;
+    }
+    if (!bgScratch.valid() || bgScratch->s() != image->s() || bgScratch->t() != image->t()
+            || bgScratch->getPixelFormat() != image->getPixelFormat()) {
+        bgScratch = new osg::Image;
+        bgScratch->allocateImage(image->s(), image->t(), 1, image->getPixelFormat(), GL_UNSIGNED_BYTE);
+        bgScratch->setInternalTextureFormat(image->getInternalTextureFormat());
+    }
+    //zoomed image is cropped at origin, so only source subregion is resampled
+    int srcWidth = osg::clampBetween((int)(image->s() / hSize), 1, image->s());
+    int srcHeight = osg::clampBetween((int)(image->t() / vSize), 1, image->t());
+    resizeImage(image->data(), srcWidth, srcHeight, image->getRowStepInBytes(), channels,
+        bgScratch->data(), bgScratch->s(), bgScratch->t(), bgScratch->getRowStepInBytes(), &resampleWorkspace);
+    if (hFlip > 0.5) {
+        flipHorizontal(bgScratch->data(), bgScratch->s(), bgScratch->t(), bgScratch->getRowStepInBytes(), channels);
+    }
+    if (vFlip > 0.5) {
+        flipVertical(bgScratch->data(), bgScratch->s(), bgScratch->t(), bgScratch->getRowStepInBytes(), channels);
     }
-    return cropped;
+    bgScratch->dirty();
+    return bgScratch.get();
 }
 
 /**
@@ -802,9 +1431,9 @@ osg::Image* ImgGenerator::cropImage(const osg::Image* image,
     @param groupCount count of objects in group, in range 1..4.
 */
 void ImgGenerator::setGroupShift(std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > transforms, osg::Vec3d position, int groupCount) {
-    int signX = getRand(0., 2.) > 1. ? 1 : -1;
-    int signY = getRand(0., 2.) > 1. ? 1 : -1;
-    int signZ = getRand(0., 2.) > 1. ? 1 : -1;
+    int signX = getRand(0., 2., RandomGenerator::GROUP_STREAM) > 1. ? 1 : -1;
+    int signY = getRand(0., 2., RandomGenerator::GROUP_STREAM) > 1. ? 1 : -1;
+    int signZ = getRand(0., 2., RandomGenerator::GROUP_STREAM) > 1. ? 1 : -1;
     if (groupCount == 1) {
         transforms[0]->setPosition( position );
     }
@@ -839,13 +1468,13 @@ void ImgGenerator::setGroupShift(osg::ref_ptr<osg::PositionAttitudeTransform> tr
     float tX = config.getOutput().objShifts.x_to;
     float tY = config.getOutput().objShifts.y_to;
     float tZ = config.getOutput().objShifts.z_to;
-    float x1 = getRand(sX, tX) * signX;
+    float x1 = getRand(sX, tX, RandomGenerator::GROUP_STREAM) * signX;
     float x2 = -x1 + position.x();
     x1 += position.x();
-    float y1 = getRand(sY, tY) * signY;
+    float y1 = getRand(sY, tY, RandomGenerator::GROUP_STREAM) * signY;
     float y2 = -y1 + position.y();
     y1 += position.y();
-    float z1 = getRand(sZ, tZ) * signZ;
+    float z1 = getRand(sZ, tZ, RandomGenerator::GROUP_STREAM) * signZ;
     float z2 = -z1 + position.z();
     z1 += position.z();
     tr->setPosition(osg::Vec3d(x1, y1, z1));
@@ -0,0 +1,121 @@
+#include "InstancedModel.h"
+#include "Shaders.h"
+
+#include <osg/Geode>
+#include <osg/NodeVisitor>
+#include <osg/CopyOp>
+
+/**
+    Inner class, collects geometries of model.
+*/
+class GeometryCollector : public osg::NodeVisitor {
+    public:
+        GeometryCollector(): osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+        virtual void apply(osg::Geode& geode) {
+            for (unsigned int i = 0; i < geode.getNumDrawables(); i++) {
+                osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+                if (geometry) {
+                    geometries.push_back(geometry);
+                }
+            }
+        }
+
+        std::vector<osg::Geometry*> geometries;
+};
+
+/**
+    Constructor, copies model nodes, drawables and primitive sets, vertex data and state stay shared
+    with original model.
+    @param model the loaded model.
+    @param _count the int count of instances, up to MAX_INSTANCES.
+    @param objectIds write 1-based instance index to object ID render target.
+    @param whiteTexture texture bound to unit 0 for untextured models.
+*/
+InstancedModel::InstancedModel(osg::Node* model, int _count, bool objectIds, osg::Texture2D* whiteTexture) {
+    count = osg::clampBetween(_count, 1, (int)MAX_INSTANCES);
+    matrices.assign(count, osg::Matrix::identity());
+    root = new osg::Group();
+    osg::Node* copy = dynamic_cast<osg::Node*>(model->clone(osg::CopyOp::DEEP_COPY_NODES
+        | osg::CopyOp::DEEP_COPY_DRAWABLES | osg::CopyOp::DEEP_COPY_PRIMITIVES));
+    root->addChild(copy);
+
+    GeometryCollector collector;
+    copy->accept(collector);
+    for (int i = 0; i < collector.geometries.size(); i++) {
+        prepareGeometry(collector.geometries[i]);
+    }
+
+    matricesUniform = new osg::Uniform(osg::Uniform::FLOAT_MAT4, "instanceMatrices", count);
+    osg::StateSet* stateSet = root->getOrCreateStateSet();
+    stateSet->setAttributeAndModes(createInstancedProgram(count, objectIds), osg::StateAttribute::ON);
+    stateSet->setTextureAttributeAndModes(0, whiteTexture, osg::StateAttribute::ON);
+    stateSet->addUniform(new osg::Uniform("baseTexture", 0));
+    stateSet->addUniform(matricesUniform.get());
+}
+
+//destructor
+InstancedModel::~InstancedModel() {
+
+}
+
+/**
+    Sets instance matrices from transformations, instances beyond count of transformations are hidden
+    by zero matrix.
+    @param transforms the list of transformations.
+*/
+void InstancedModel::setInstanceMatrices(const std::vector<osg::ref_ptr<osg::PositionAttitudeTransform> > &transforms) {
+    for (int i = 0; i < count; i++) {
+        if (i < transforms.size()) {
+            matrices[i].makeIdentity();
+            transforms[i]->computeLocalToWorldMatrix(matrices[i], NULL);
+        }
+        else {
+            matrices[i].set(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        }
+        matricesUniform->setElement(i, osg::Matrixf(matrices[i]));
+    }
+    for (int i = 0; i < geometries.size(); i++) {
+        geometries[i]->dirtyBound();
+    }
+}
+
+/**
+    Switches geometry to instanced drawing from vertex buffer objects,
+    display lists do not support instancing.
+    @param geometry the copied geometry.
+*/
+void InstancedModel::prepareGeometry(osg::Geometry* geometry) {
+    geometry->setUseDisplayList(false);
+    geometry->setUseVertexBufferObjects(true);
+    for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); i++) {
+        geometry->getPrimitiveSet(i)->setNumInstances(count);
+    }
+    geometry->setComputeBoundingBoxCallback(new BoundCallback(&matrices));
+    geometry->dirtyBound();
+    geometries.push_back(geometry);
+}
+
+/**
+    Computes bounding box of drawable including all instances.
+    @param drawable the instanced drawable.
+    @return union of drawable boxes transformed by instance matrices
+*/
+osg::BoundingBox InstancedModel::BoundCallback::computeBound(const osg::Drawable& drawable) const {
+    osg::BoundingBox local = drawable.computeBoundingBox();
+    osg::BoundingBox result;
+    if (!local.valid()) {
+        return result;
+    }
+    for (int i = 0; i < matrices->size(); i++) {
+        const osg::Matrix& m = (*matrices)[i];
+        //hidden instance
+        if (m(3, 3) == 0.0) {
+            continue;
+        }
+        for (int corner = 0; corner < 8; corner++) {
+            result.expandBy(local.corner(corner) * m);
+        }
+    }
+    return result;
+}
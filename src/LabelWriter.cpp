@@ -0,0 +1,186 @@
+#include "LabelWriter.h"
+
+#include <string.h>
+
+#include <sstream>
+
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+
+//max length of formatted number
+static const size_t NUMBER_SIZE = 32;
+
+//constructor
+LabelWriter::LabelWriter(size_t _chunkSize) : file(NULL), binaryFile(NULL), chunkSize(_chunkSize), used(0), rowStart(0),
+        keepLastRow(false), writeFailed(false), binaryUsed(0) {
+    buffer.resize(chunkSize + NUMBER_SIZE);
+    binaryBuffer.resize(chunkSize);
+}
+
+//destructor, writes buffered rows, file is closed by owner
+LabelWriter::~LabelWriter() {
+    flush();
+}
+
+/**
+    Sets files receiving rows, rows buffered for previous files are written to them first.
+    @param _file the file of text rows opened for writing, or NULL to discard rows.
+    @param _binaryFile the file of binary records, or NULL to discard records.
+*/
+void LabelWriter::setFile(FILE* _file, FILE* _binaryFile) {
+    flush();
+    file = _file;
+    binaryFile = _binaryFile;
+}
+
+/**
+    Starts a new row with image name and index.
+    @param name the file name of generated image.
+    @param index the int file index, first column of binary record.
+*/
+void LabelWriter::beginRow(const std::string &name, int index) {
+    reserve(name.size());
+    memcpy(&buffer[used], name.data(), name.size());
+    used += name.size();
+    if (binaryFile) {
+        int value = index;
+        appendBinary(&value, sizeof(value));
+    }
+}
+
+/**
+    Appends comma and number to current text row and float column to binary record.
+    @param value the number.
+*/
+void LabelWriter::addNumber(double value) {
+    reserve(NUMBER_SIZE);
+    buffer[used++] = ',';
+    used += formatNumber(&buffer[used], NUMBER_SIZE - 1, value);
+    addBinaryNumber(value);
+}
+
+/**
+    Appends comma and text to current text row only, text should not contain commas or quotes.
+    @param text the text value.
+*/
+void LabelWriter::addText(const std::string &text) {
+    reserve(text.size() + 1);
+    buffer[used++] = ',';
+    memcpy(&buffer[used], text.data(), text.size());
+    used += text.size();
+}
+
+/**
+    Appends float column to binary record only.
+    @param value the number.
+*/
+void LabelWriter::addBinaryNumber(double value) {
+    if (binaryFile) {
+        float column = (float)value;
+        appendBinary(&column, sizeof(column));
+    }
+}
+
+//Ends current row, buffers are written to files if chunk is full.
+void LabelWriter::endRow() {
+    buffer[used++] = '\n';
+    if (keepLastRow) {
+        lastRow.assign(&buffer[rowStart], used - rowStart);
+    }
+    rowStart = used;
+    if (used >= chunkSize || binaryUsed >= chunkSize) {
+        flush();
+    }
+}
+
+/**
+    Writes buffered rows to files, stdio buffers of files are not flushed.
+    @return false if rows can not be written
+*/
+bool LabelWriter::flush() {
+    bool written = !writeFailed;
+    writeFailed = false;
+    if (file && used > 0) {
+        written = fwrite(&buffer[0], 1, used, file) == used && written;
+    }
+    if (binaryFile && binaryUsed > 0) {
+        written = fwrite(&binaryBuffer[0], 1, binaryUsed, binaryFile) == binaryUsed && written;
+    }
+    used = 0;
+    rowStart = 0;
+    binaryUsed = 0;
+    return written;
+}
+
+//Appends bytes to binary buffer, buffer grows if record is longer than chunk.
+void LabelWriter::appendBinary(const void* data, size_t size) {
+    if (binaryUsed + size > binaryBuffer.size()) {
+        binaryBuffer.resize(binaryUsed + size);
+    }
+    memcpy(&binaryBuffer[binaryUsed], data, size);
+    binaryUsed += size;
+}
+
+/**
+    Creates header of .npy version 1.0 file of one-dimensional array of records,
+    first column is int32, others are float32. Header is padded so data starts at 64 byte boundary.
+    @param columns names of record columns.
+    @param rows the long count of records.
+    @return header bytes
+*/
+std::string LabelWriter::npyHeader(const std::vector<std::string> &columns, long rows) {
+    std::ostringstream dict;
+    dict << "{'descr': [";
+    for (int i = 0; i < columns.size(); i++) {
+        dict << (i > 0 ? ", " : "") << "('" << columns[i] << "', '" << (i == 0 ? "<i4" : "<f4") << "')";
+    }
+    dict << "], 'fortran_order': False, 'shape': (" << rows << ",), }";
+    std::string text = dict.str();
+    //magic, version and header length take 10 bytes, header ends with new line
+    size_t total = 10 + text.size() + 1;
+    text.append((64 - total % 64) % 64, ' ');
+    text += '\n';
+    std::string header("\x93NUMPY\x01\x00", 8);
+    header += (char)(text.size() & 0xff);
+    header += (char)(text.size() >> 8);
+    return header + text;
+}
+
+//Writes complete rows if there is no place for specified count of bytes and end of row, buffer grows for long row.
+void LabelWriter::reserve(size_t size) {
+    if (used + size + 1 <= buffer.size()) {
+        return;
+    }
+    if (rowStart > 0) {
+        //error is reported by next flush
+        if (file && fwrite(&buffer[0], 1, rowStart, file) != rowStart) {
+            writeFailed = true;
+        }
+        memmove(&buffer[0], &buffer[rowStart], used - rowStart);
+        used -= rowStart;
+        rowStart = 0;
+    }
+    if (used + size + 1 > buffer.size()) {
+        buffer.resize(used + size + 1);
+    }
+}
+
+/**
+    Formats number as shortest text which is parsed back to the same float.
+    @param buffer the output buffer, not terminated by zero.
+    @param size the int size of buffer.
+    @param value the number.
+    @return the int count of written chars
+*/
+int LabelWriter::formatNumber(char* buffer, int size, double value) {
+#if defined(__cpp_lib_to_chars)
+    std::to_chars_result result = std::to_chars(buffer, buffer + size, (float)value);
+    if (result.ec == std::errc()) {
+        return result.ptr - buffer;
+    }
+#endif
+    //9 significant digits are enough to restore float
+    int length = snprintf(buffer, size, "%.9g", (float)value);
+    return length < size ? length : size - 1;
+}
@@ -0,0 +1,264 @@
+#include "ModelCache.h"
+
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <osg/Notify>
+#include <osg/NodeVisitor>
+#include <osg/Geode>
+#include <osg/StateSet>
+#include <osg/Texture>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+#include <set>
+
+//FNV-1a 64-bit parameters
+static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+/**
+    Inner class, collects file names of texture images of model.
+*/
+class ImageFileCollector : public osg::NodeVisitor {
+    public:
+        ImageFileCollector(std::set<std::string> &_files):
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), files(_files) {}
+
+        virtual void apply(osg::Node& node) {
+            addStateSet(node.getStateSet());
+            traverse(node);
+        }
+
+        virtual void apply(osg::Geode& geode) {
+            addStateSet(geode.getStateSet());
+            for (unsigned int i = 0; i < geode.getNumDrawables(); i++) {
+                addStateSet(geode.getDrawable(i)->getStateSet());
+            }
+        }
+    private:
+        void addStateSet(osg::StateSet* stateSet) {
+            if (!stateSet) {
+                return;
+            }
+            for (unsigned int unit = 0; unit < stateSet->getNumTextureAttributeLists(); unit++) {
+                osg::Texture* texture = dynamic_cast<osg::Texture*>(
+                    stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+                if (!texture) {
+                    continue;
+                }
+                for (unsigned int i = 0; i < texture->getNumImages(); i++) {
+                    osg::Image* image = texture->getImage(i);
+                    if (image && !image->getFileName().empty()) {
+                        files.insert(image->getFileName());
+                    }
+                }
+            }
+        }
+
+        std::set<std::string> &files;
+};
+
+//constructor, creates cache folder
+ModelCache::ModelCache(const std::string &_folder, const std::string &_variant) : folder(_folder), variant(_variant) {
+    std::string command = "mkdir -p " + folder;
+    if (system(command.c_str()) != 0) {
+        osg::notify(osg::WARN) << "Model cache folder '" << folder << "' can not be created" << std::endl;
+    }
+    writeOptions = new osgDB::Options("WriteImageHint=IncludeData");
+}
+
+//destructor
+ModelCache::~ModelCache() {
+
+}
+
+/**
+    Reads cached model if its key matches the source file and stamps of texture images
+    stored after the key match their files.
+    @param fileName path to source model file.
+    @param key the computed key of source file, to be passed to write on cache miss.
+    @return cached model, or NULL if it is missing or stale
+*/
+osg::Node* ModelCache::read(const std::string &fileName, std::string &key) {
+    key = computeKey(fileName);
+    if (key.empty()) {
+        return NULL;
+    }
+    std::ifstream keyFile(cachePath(fileName, ".key").c_str(), std::ios::binary);
+    if (!keyFile) {
+        return NULL;
+    }
+    std::stringstream stored;
+    stored << keyFile.rdbuf();
+    std::string text = stored.str();
+    if (text.compare(0, key.size(), key) != 0 || (text.size() > key.size() && text[key.size()] != '\n')) {
+        return NULL;
+    }
+    //texture images are known only after model is loaded, so their count and stamps are stored after the key
+    std::istringstream images(text.substr(key.size()));
+    std::string line;
+    std::string keyword;
+    int count = -1;
+    std::getline(images, line);
+    if (!(images >> keyword >> count) || keyword != "images") {
+        return NULL;
+    }
+    std::getline(images, line);
+    for (int i = 0; i < count; i++) {
+        size_t tab = std::string::npos;
+        if (std::getline(images, line)) {
+            tab = line.find('\t');
+        }
+        if (tab == std::string::npos || line != fileStamp(line.substr(0, tab))) {
+            return NULL;
+        }
+    }
+    return osgDB::readNodeFile(cachePath(fileName, ".osgb"));
+}
+
+/**
+    Writes model to cache. Model is written to temporary file and renamed,
+    key file is written last, so interrupted write never leaves valid key.
+    Stamps of texture images of model are written after the key.
+    @param fileName path to source model file.
+    @param key the key of source file returned by read.
+    @param node the loaded model.
+*/
+void ModelCache::write(const std::string &fileName, const std::string &key, osg::Node* node) {
+    if (key.empty() || !node) {
+        return;
+    }
+    std::string modelPath = cachePath(fileName, ".osgb");
+    std::string keyPath = cachePath(fileName, ".key");
+    remove(keyPath.c_str());
+    std::string tmpModelPath = cachePath(fileName, ".tmp.osgb");
+    if (!osgDB::writeNodeFile(*node, tmpModelPath, writeOptions.get()) ||
+            rename(tmpModelPath.c_str(), modelPath.c_str()) != 0) {
+        osg::notify(osg::WARN) << "Model '" << fileName << "' can not be written to cache" << std::endl;
+        remove(tmpModelPath.c_str());
+        return;
+    }
+    std::string tmpKeyPath = cachePath(fileName, ".tmp.key");
+    std::set<std::string> images;
+    ImageFileCollector collector(images);
+    node->accept(collector);
+    std::ofstream keyFile(tmpKeyPath.c_str(), std::ios::binary);
+    keyFile << key << "\nimages " << images.size();
+    for (std::set<std::string>::const_iterator it = images.begin(); it != images.end(); ++it) {
+        keyFile << "\n" << fileStamp(resolvePath(fileName, *it));
+    }
+    keyFile.close();
+    if (!keyFile || rename(tmpKeyPath.c_str(), keyPath.c_str()) != 0) {
+        remove(tmpKeyPath.c_str());
+    }
+}
+
+/**
+    Computes key of source file: path, modification time, size, content hash, processing settings
+    and stamps of material libraries referenced by .obj file.
+    @param fileName path to source model file.
+    @return key text, or empty string if file can not be read
+*/
+std::string ModelCache::computeKey(const std::string &fileName) {
+    struct stat sb;
+    if (stat(fileName.c_str(), &sb) != 0) {
+        return "";
+    }
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    if (!file) {
+        return "";
+    }
+    unsigned long long hash = FNV_OFFSET;
+    char buffer[65536];
+    while (file) {
+        file.read(buffer, sizeof(buffer));
+        hash = hashBytes(buffer, file.gcount(), hash);
+    }
+    std::stringstream key;
+    key << fileName << "\n" << (long long)sb.st_mtime << "\n" << (long long)sb.st_size << "\n" << toHex(hash) << "\n" << variant;
+    if (osgDB::getLowerCaseFileExtension(fileName) == "obj") {
+        std::ifstream obj(fileName.c_str());
+        std::string line;
+        while (std::getline(obj, line)) {
+            std::istringstream ss(line);
+            std::string keyword;
+            std::string library;
+            if (!(ss >> keyword) || keyword != "mtllib") {
+                continue;
+            }
+            while (ss >> library) {
+                key << "\n" << fileStamp(resolvePath(fileName, library));
+            }
+        }
+    }
+    return key.str();
+}
+
+/**
+    Resolves path of file referenced by model, relative paths are relative to model folder
+    or found in osg data file path.
+    @param fileName path to source model file.
+    @param reference the referenced file name.
+    @return resolved path, or reference itself if file is not found
+*/
+std::string ModelCache::resolvePath(const std::string &fileName, const std::string &reference) {
+    std::string path = osgDB::concatPaths(osgDB::getFilePath(fileName), reference);
+    if (!osgDB::isAbsolutePath(reference) && osgDB::fileExists(path)) {
+        return path;
+    }
+    if (osgDB::fileExists(reference)) {
+        return reference;
+    }
+    std::string found = osgDB::findDataFile(reference);
+    return found.empty() ? reference : found;
+}
+
+/**
+    Returns stamp of file: path, modification time and size separated by tabs.
+    @param path the path to file.
+    @return stamp text, time and size are -1 if file is missing
+*/
+std::string ModelCache::fileStamp(const std::string &path) {
+    struct stat sb;
+    std::stringstream stamp;
+    if (stat(path.c_str(), &sb) != 0) {
+        stamp << path << "\t-1\t-1";
+    }
+    else {
+        stamp << path << "\t" << (long long)sb.st_mtime << "\t" << (long long)sb.st_size;
+    }
+    return stamp.str();
+}
+
+/**
+    Returns path of cache file, named by hash of source path.
+    @param fileName path to source model file.
+    @param extension the cache file extension.
+    @return path of cache file
+*/
+std::string ModelCache::cachePath(const std::string &fileName, const std::string &extension) {
+    return folder + "/" + toHex(hashBytes(fileName.c_str(), fileName.size(), FNV_OFFSET)) + extension;
+}
+
+//Continues FNV-1a hash with specified bytes.
+unsigned long long ModelCache::hashBytes(const char* data, size_t size, unsigned long long hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+//Formats value as 16 hex digits.
+std::string ModelCache::toHex(unsigned long long value) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", value);
+    return std::string(buffer);
+}
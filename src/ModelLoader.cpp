@@ -0,0 +1,132 @@
+#include "ModelLoader.h"
+#include "Profiler.h"
+
+#include <osgDB/ReadFile>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <OpenThreads/ScopedLock>
+
+//constructor
+ModelLoader::ModelLoader(const std::vector<std::string> &_files, int _threadCount, ModelCache* _cache,
+        ModelOptimizer* _optimizer) : files(_files), cache(_cache), optimizer(_optimizer) {
+    threadCount = _threadCount > 0 ? _threadCount : OpenThreads::GetNumberOfProcessors();
+    if (threadCount > (int)files.size()) {
+        threadCount = files.size();
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    nextIndex = 0;
+}
+
+//destructor
+ModelLoader::~ModelLoader() {
+
+}
+
+/**
+    Loads all files, single thread loads on the calling thread.
+    Models which can not be read are skipped.
+    @return map containing loaded models as osg::Node objects, keyed by file name
+*/
+std::map<std::string, osg::Node*> ModelLoader::load() {
+    nodes.assign(files.size(), osg::ref_ptr<osg::Node>());
+    loadTimes.assign(files.size(), 0.0);
+    cached.assign(files.size(), 0);
+    statsBefore.assign(files.size(), GeometryStats());
+    statsAfter.assign(files.size(), GeometryStats());
+    nextIndex = 0;
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    if (threadCount == 1) {
+        int index;
+        while (nextFile(index)) {
+            loadFile(index);
+        }
+    }
+    else {
+        std::vector<Worker*> workers;
+        for (int i = 0; i < threadCount; i++) {
+            workers.push_back(new Worker(this));
+            workers.back()->start();
+        }
+        for (int i = 0; i < workers.size(); i++) {
+            workers[i]->join();
+            delete workers[i];
+        }
+    }
+    //map ordering does not depend on completion order of workers
+    std::map<std::string, osg::Node*> models;
+    for (int i = 0; i < files.size(); i++) {
+        if (nodes[i].valid()) {
+            osg::notify(osg::NOTICE) << "Model '" << files[i] << "' loaded in " << loadTimes[i] << " s"
+                << (cached[i] ? " from cache" : "") << std::endl;
+            if (optimizer.valid() && !cached[i]) {
+                osg::notify(osg::NOTICE) << "Model '" << files[i] << "' optimized: draw calls "
+                    << statsBefore[i].drawCalls << " -> " << statsAfter[i].drawCalls << ", triangles "
+                    << statsBefore[i].triangles << " -> " << statsAfter[i].triangles << std::endl;
+            }
+            else if (optimizer.valid()) {
+                GeometryStats stats = ModelOptimizer::computeStats(nodes[i].get());
+                osg::notify(osg::NOTICE) << "Model '" << files[i] << "' optimized in cache: draw calls "
+                    << stats.drawCalls << ", triangles " << stats.triangles << std::endl;
+            }
+            //ownership is passed to the caller
+            models[files[i]] = nodes[i].release();
+        }
+        else {
+            osg::notify(osg::NOTICE) << "Model file '" << files[i] << "' can not be read" << std::endl;
+        }
+    }
+    osg::notify(osg::NOTICE) << models.size() << " models loaded in "
+        << osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick())
+        << " s by " << threadCount << " threads" << std::endl;
+    return models;
+}
+
+/**
+    Takes index of the next file to load.
+    @param index the int index of file.
+    @return false if all files are taken
+*/
+bool ModelLoader::nextFile(int &index) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(indexMutex);
+    if (nextIndex >= (int)files.size()) {
+        return false;
+    }
+    index = nextIndex++;
+    return true;
+}
+
+/**
+    Reads model file, or its cached copy if it is valid. Loaded model is optimized
+    and written to cache, cached models are already optimized.
+    Result is stored to its own slot, so no locking is needed.
+    @param index the int index of file.
+*/
+void ModelLoader::loadFile(int index) {
+    StageTimer timer(Profiler::MODEL_LOAD);
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    std::string key;
+    if (cache.valid()) {
+        nodes[index] = cache->read(files[index], key);
+        cached[index] = nodes[index].valid();
+    }
+    if (!nodes[index].valid()) {
+        nodes[index] = osgDB::readNodeFile(files[index]);
+        if (optimizer.valid() && nodes[index].valid()) {
+            optimizer->optimize(nodes[index].get(), statsBefore[index], statsAfter[index]);
+        }
+        if (cache.valid() && nodes[index].valid()) {
+            cache->write(files[index], key, nodes[index].get());
+        }
+    }
+    loadTimes[index] = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+}
+
+//Loads files until the list is exhausted.
+void ModelLoader::Worker::run() {
+    int index;
+    while (loader->nextFile(index)) {
+        loader->loadFile(index);
+    }
+}
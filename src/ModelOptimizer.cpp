@@ -0,0 +1,149 @@
+#include "ModelOptimizer.h"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <osgUtil/Optimizer>
+#include <osgUtil/Simplifier>
+
+#include <sstream>
+
+//scene graph passes, applied before simplification
+static const unsigned int STRUCTURE_OPTIONS =
+    osgUtil::Optimizer::STATIC_OBJECT_DETECTION |
+    osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS |
+    osgUtil::Optimizer::REMOVE_REDUNDANT_NODES |
+    osgUtil::Optimizer::REMOVE_LOADED_PROXY_NODES |
+    osgUtil::Optimizer::COMBINE_ADJACENT_LODS |
+    osgUtil::Optimizer::SHARE_DUPLICATE_STATE |
+    osgUtil::Optimizer::MERGE_GEODES |
+    osgUtil::Optimizer::MERGE_GEOMETRY |
+    osgUtil::Optimizer::CHECK_GEOMETRY;
+
+//mesh passes, applied to final geometry
+static const unsigned int MESH_OPTIONS =
+    osgUtil::Optimizer::INDEX_MESH |
+    osgUtil::Optimizer::VERTEX_POSTTRANSFORM |
+    osgUtil::Optimizer::VERTEX_PRETRANSFORM;
+
+/**
+    Inner class, visits geometries of model: collects statistics
+    and optionally switches geometries from display lists to vertex buffer objects.
+*/
+class GeometryVisitor : public osg::NodeVisitor {
+    public:
+        GeometryVisitor(bool _useVbo):
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), useVbo(_useVbo) {}
+
+        virtual void apply(osg::Geode& geode) {
+            for (unsigned int i = 0; i < geode.getNumDrawables(); i++) {
+                osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+                if (geometry) {
+                    apply(*geometry);
+                }
+            }
+            //drawables are the only children of geode, so it is not traversed
+        }
+
+        void apply(osg::Geometry& geometry) {
+            if (useVbo) {
+                geometry.setUseDisplayList(false);
+                geometry.setUseVertexBufferObjects(true);
+            }
+            for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); i++) {
+                const osg::PrimitiveSet* primitives = geometry.getPrimitiveSet(i);
+                stats.drawCalls++;
+                stats.triangles += countTriangles(primitives);
+            }
+        }
+
+        GeometryStats stats;
+    private:
+        //count of triangles drawn by primitive set, lines and points are not counted
+        static unsigned int countTriangles(const osg::PrimitiveSet* primitives) {
+            unsigned int indices = primitives->getNumIndices();
+            switch (primitives->getMode()) {
+                case osg::PrimitiveSet::TRIANGLES:
+                    return indices / 3;
+                case osg::PrimitiveSet::QUADS:
+                    return indices / 4 * 2;
+                case osg::PrimitiveSet::TRIANGLE_STRIP:
+                case osg::PrimitiveSet::TRIANGLE_FAN:
+                case osg::PrimitiveSet::QUAD_STRIP:
+                case osg::PrimitiveSet::POLYGON: {
+                    //each primitive of strip, fan or polygon loses two vertices
+                    unsigned int count = primitives->getNumPrimitives();
+                    return indices > 2 * count ? indices - 2 * count : 0;
+                }
+                default:
+                    return 0;
+            }
+        }
+
+        bool useVbo;
+};
+
+//constructor
+ModelOptimizer::ModelOptimizer(int _targetTriangles) {
+    targetTriangles = _targetTriangles > 0 ? _targetTriangles : 0;
+}
+
+//destructor
+ModelOptimizer::~ModelOptimizer() {
+
+}
+
+/**
+    Optimizes model in place.
+    @param node the loaded model.
+    @param before output statistics of model before optimization.
+    @param after output statistics of optimized model.
+*/
+void ModelOptimizer::optimize(osg::Node* node, GeometryStats &before, GeometryStats &after) {
+    before = computeStats(node);
+    osgUtil::Optimizer optimizer;
+    optimizer.optimize(node, STRUCTURE_OPTIONS);
+    if (targetTriangles > 0) {
+        GeometryStats merged = computeStats(node);
+        if (merged.triangles > (unsigned int)targetTriangles) {
+            simplify(node, merged.triangles);
+        }
+    }
+    optimizer.reset();
+    optimizer.optimize(node, MESH_OPTIONS);
+    GeometryVisitor visitor(true);
+    node->accept(visitor);
+    after = visitor.stats;
+}
+
+/**
+    Returns text identifying optimizer settings, it is a part of model cache key,
+    so models cached with other settings are not used.
+    @return settings text
+*/
+std::string ModelOptimizer::getSignature() const {
+    std::ostringstream ss;
+    ss << "optimize " << STRUCTURE_OPTIONS << " " << MESH_OPTIONS << " " << targetTriangles << "\n";
+    return ss.str();
+}
+
+/**
+    Computes count of draw calls and triangles of model.
+    @param node the model.
+    @return statistics of model
+*/
+GeometryStats ModelOptimizer::computeStats(osg::Node* node) {
+    GeometryVisitor visitor(false);
+    node->accept(visitor);
+    return visitor.stats;
+}
+
+/**
+    Reduces count of triangles of model to target count, by edge collapsing.
+    @param node the model.
+    @param triangles current count of triangles.
+*/
+void ModelOptimizer::simplify(osg::Node* node, unsigned int triangles) {
+    osgUtil::Simplifier simplifier((float)targetTriangles / triangles);
+    node->accept(simplifier);
+}
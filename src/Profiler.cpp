@@ -0,0 +1,150 @@
+#include "Profiler.h"
+
+#include <time.h>
+#include <string.h>
+
+#include <fstream>
+#include <iomanip>
+
+//names of stages in report
+static const char* STAGE_NAMES[Profiler::STAGE_COUNT] = {"background_decode", "model_load", "set_translation",
+    "frame", "readback", "scale", "encode", "write", "wait"};
+
+//constructor
+Profiler::Profiler() {
+    memset(counts, 0, sizeof(counts));
+    memset(samples, 0, sizeof(samples));
+    memset(totals, 0, sizeof(totals));
+    memset(maxima, 0, sizeof(maxima));
+}
+
+//Returns profiler shared by all threads of process.
+Profiler* Profiler::instance() {
+    static Profiler profiler;
+    return &profiler;
+}
+
+//Returns monotonic time in nanoseconds.
+uint64_t Profiler::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//Returns name of stage.
+const char* Profiler::stageName(int stage) {
+    return STAGE_NAMES[stage];
+}
+
+/**
+    Returns histogram bucket of duration: durations below 8 ns have own buckets,
+    longer ones are split by power of two and 3 next bits.
+    @param duration the duration in nanoseconds.
+    @return index of bucket
+*/
+int Profiler::bucket(uint64_t duration) {
+    if (duration < 8) {
+        return duration;
+    }
+    int exponent = 63 - __builtin_clzll(duration);
+    return exponent * 8 + ((duration >> (exponent - 3)) & 7);
+}
+
+//Returns middle duration of bucket in nanoseconds.
+double Profiler::bucketValue(int index) {
+    if (index < 8) {
+        return index;
+    }
+    int exponent = index / 8;
+    double low = (double)(8 + index % 8) * (1ull << (exponent - 3));
+    return low + (double)(1ull << (exponent - 3)) / 2;
+}
+
+/**
+    Records duration of stage.
+    @param stage the Stage.
+    @param duration the duration in nanoseconds.
+*/
+void Profiler::record(int stage, uint64_t duration) {
+    __atomic_fetch_add(&counts[stage][bucket(duration)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&samples[stage], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals[stage], duration, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&maxima[stage], __ATOMIC_RELAXED);
+    while (duration > max && !__atomic_compare_exchange_n(&maxima[stage], &max, duration, true,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+    Returns percentile of stage durations.
+    @param stage the Stage.
+    @param p the double fraction of samples, e.g. 0.95.
+    @return the duration in seconds, 0 if stage has no samples
+*/
+double Profiler::percentile(int stage, double p) const {
+    uint64_t count = samples[stage];
+    if (count == 0) {
+        return 0.0;
+    }
+    uint64_t rank = (uint64_t)(p * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[stage][i];
+        if (seen >= rank) {
+            double value = bucketValue(i);
+            return (value < maxima[stage] ? value : maxima[stage]) * 1e-9;
+        }
+    }
+    return maxima[stage] * 1e-9;
+}
+
+/**
+    Prints table of stages with count, total time, mean and percentiles in milliseconds.
+    @param out the output stream.
+*/
+void Profiler::print(std::ostream &out) const {
+    out << "Performance:" << std::endl;
+    out << std::setw(18) << std::left << "stage" << std::right << std::setw(9) << "count" << std::setw(11) << "total s"
+        << std::setw(10) << "mean ms" << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms"
+        << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (samples[i] == 0) {
+            continue;
+        }
+        out << std::setw(18) << std::left << STAGE_NAMES[i] << std::right << std::setw(9) << samples[i]
+            << std::setprecision(3) << std::setw(11) << totals[i] * 1e-9
+            << std::setw(10) << totals[i] * 1e-6 / samples[i]
+            << std::setw(10) << percentile(i, 0.5) * 1e3 << std::setw(10) << percentile(i, 0.95) * 1e3
+            << std::setw(10) << percentile(i, 0.99) * 1e3 << std::setw(10) << maxima[i] * 1e-6 << std::endl;
+    }
+    out.flags(flags);
+}
+
+/**
+    Writes report of all stages as JSON object: stage name maps to count, total_s, mean_ms,
+    p50_ms, p95_ms, p99_ms and max_ms.
+    @param fileName path to report file.
+    @return false if file can not be written
+*/
+bool Profiler::writeJson(const std::string &fileName) const {
+    std::ofstream out(fileName.c_str());
+    out << "{\n  \"stages\": {";
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        out << (i > 0 ? "," : "") << "\n    \"" << STAGE_NAMES[i] << "\": {"
+            << "\"count\": " << samples[i]
+            << ", \"total_s\": " << totals[i] * 1e-9
+            << ", \"mean_ms\": " << (samples[i] > 0 ? totals[i] * 1e-6 / samples[i] : 0.0)
+            << ", \"p50_ms\": " << percentile(i, 0.5) * 1e3
+            << ", \"p95_ms\": " << percentile(i, 0.95) * 1e3
+            << ", \"p99_ms\": " << percentile(i, 0.99) * 1e3
+            << ", \"max_ms\": " << maxima[i] * 1e-6 << "}";
+    }
+    out << "\n  }\n}" << std::endl;
+    out.close();
+    return !out.fail();
+}
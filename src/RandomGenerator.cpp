@@ -0,0 +1,62 @@
+#include "RandomGenerator.h"
+
+//odd constant of golden ratio, increment of SplitMix64
+static const unsigned long long GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+//constructor
+RandomGenerator::RandomGenerator(unsigned long long _seed) : seed(_seed) {
+    setImage(0);
+}
+
+/**
+    Starts draws of specified image, counters of all streams are reset.
+    @param index the global image index.
+*/
+void RandomGenerator::setImage(long long index) {
+    image = index;
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        counters[i] = 0;
+    }
+}
+
+/**
+    Returns next value of stream.
+    @param stream the stream of draws.
+    @return a pseudo-random double in range [0, 1)
+*/
+double RandomGenerator::uniform(int stream) {
+    unsigned long long slot = ((unsigned long long)stream << 32) | counters[stream]++;
+    unsigned long long value = mix(seed + GOLDEN_GAMMA * (unsigned long long)(image + 1));
+    value = mix(value + GOLDEN_GAMMA * (slot + 1));
+    //53 high bits fill double mantissa
+    return (value >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+    Returns next value of stream in specified range.
+    @param from the double minimal range value.
+    @param to the double maximal range value.
+    @param stream the stream of draws.
+    @return a pseudo-random double between from and to
+*/
+double RandomGenerator::uniform(double from, double to, int stream) {
+    return from + uniform(stream) * (to - from);
+}
+
+/**
+    Returns next integer value of stream in specified range.
+    @param min the int minimal value.
+    @param max the int maximal value, inclusive.
+    @param stream the stream of draws.
+    @return a pseudo-random int between min and max
+*/
+int RandomGenerator::uniformInt(int min, int max, int stream) {
+    return min + (int)(uniform(stream) * (max - min + 1));
+}
+
+//SplitMix64 finalizer, bijective mixing of 64-bit value.
+unsigned long long RandomGenerator::mix(unsigned long long value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
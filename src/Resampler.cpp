@@ -0,0 +1,410 @@
+#include "Resampler.h"
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLER_X86
+#include <immintrin.h>
+#endif
+
+//weights of bilinear filter are fixed point numbers with 8 fractional bits
+static const int WEIGHT_ONE = 256;
+
+/**
+    Row kernels: sums[i] += src[i], and out[i] = a[i] * wa + b[i] * wb, with wa + wb = 256.
+    16-bit results do not overflow: box sums use at most 257 rows, lerp results are at most 255 * 256.
+*/
+typedef void (*AddRowFunc)(unsigned short* sums, const unsigned char* src, int n);
+typedef void (*LerpRowsFunc)(unsigned short* out, const unsigned char* a, const unsigned char* b,
+        int n, int wa, int wb);
+
+static void addRowScalar(unsigned short* sums, const unsigned char* src, int n) {
+    for (int i = 0; i < n; i++) {
+        sums[i] += src[i];
+    }
+}
+
+static void lerpRowsScalar(unsigned short* out, const unsigned char* a, const unsigned char* b,
+        int n, int wa, int wb) {
+    for (int i = 0; i < n; i++) {
+        out[i] = (unsigned short)(a[i] * wa + b[i] * wb);
+    }
+}
+
+#ifdef RESAMPLER_X86
+__attribute__((target("sse2")))
+static void addRowSse2(unsigned short* sums, const unsigned char* src, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_loadu_si128((const __m128i*)(sums + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(sums + i + 8));
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(sums + i), lo);
+        _mm_storeu_si128((__m128i*)(sums + i + 8), hi);
+    }
+    addRowScalar(sums + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void lerpRowsSse2(unsigned short* out, const unsigned char* a, const unsigned char* b,
+        int n, int wa, int wb) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i va = _mm_set1_epi16((short)wa);
+    const __m128i vb = _mm_set1_epi16((short)wb);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i pa = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i pb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pa, zero), va),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(pb, zero), vb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pa, zero), va),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(pb, zero), vb));
+        _mm_storeu_si128((__m128i*)(out + i), lo);
+        _mm_storeu_si128((__m128i*)(out + i + 8), hi);
+    }
+    lerpRowsScalar(out + i, a + i, b + i, n - i, wa, wb);
+}
+
+__attribute__((target("avx2")))
+static void addRowAvx2(unsigned short* sums, const unsigned char* src, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(sums + i));
+        _mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(s, v));
+    }
+    addRowScalar(sums + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void lerpRowsAvx2(unsigned short* out, const unsigned char* a, const unsigned char* b,
+        int n, int wa, int wb) {
+    const __m256i va = _mm256_set1_epi16((short)wa);
+    const __m256i vb = _mm256_set1_epi16((short)wb);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i pa = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+        __m256i pb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+        __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(pa, va), _mm256_mullo_epi16(pb, vb));
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+    }
+    lerpRowsScalar(out + i, a + i, b + i, n - i, wa, wb);
+}
+#endif
+
+//Selects row kernel supported by CPU.
+static AddRowFunc selectAddRow() {
+#ifdef RESAMPLER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return addRowAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return addRowSse2;
+    }
+#endif
+    return addRowScalar;
+}
+
+//Selects row kernel supported by CPU.
+static LerpRowsFunc selectLerpRows() {
+#ifdef RESAMPLER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return lerpRowsAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return lerpRowsSse2;
+    }
+#endif
+    return lerpRowsScalar;
+}
+
+//kernels are selected during static initialization, before writer threads are started
+static AddRowFunc addRowKernel = selectAddRow();
+static LerpRowsFunc lerpRowsKernel = selectLerpRows();
+
+/**
+    Forces row kernels of specified instruction set, used to compare kernels with each other.
+    Should not be called while images are resampled by other threads.
+    @param kernel the ResampleKernel value, RESAMPLE_AUTO restores kernels selected by CPU.
+    @return true on success, false if kernel is not supported by CPU
+*/
+bool setResampleKernel(int kernel) {
+    switch (kernel) {
+        case RESAMPLE_AUTO:
+            addRowKernel = selectAddRow();
+            lerpRowsKernel = selectLerpRows();
+            return true;
+        case RESAMPLE_SCALAR:
+            addRowKernel = addRowScalar;
+            lerpRowsKernel = lerpRowsScalar;
+            return true;
+#ifdef RESAMPLER_X86
+        case RESAMPLE_SSE2:
+            if (!__builtin_cpu_supports("sse2")) {
+                return false;
+            }
+            addRowKernel = addRowSse2;
+            lerpRowsKernel = lerpRowsSse2;
+            return true;
+        case RESAMPLE_AVX2:
+            if (!__builtin_cpu_supports("avx2")) {
+                return false;
+            }
+            addRowKernel = addRowAvx2;
+            lerpRowsKernel = lerpRowsAvx2;
+            return true;
+#endif
+    }
+    return false;
+}
+
+/**
+    Downsamples image by integer factor using box filter.
+    @param src the source pixels.
+    @param srcWidth the int source width.
+    @param srcHeight the int source height.
+    @param srcStride the int size of source row in bytes.
+    @param channels the int count of channels, interleaved.
+    @param factor the int downsample factor.
+    @param dst the destination pixels, at least (srcHeight / factor) rows.
+    @param dstStride the int size of destination row in bytes.
+    @param workspace the temporary buffers, can be NULL.
+*/
+void downsampleBox(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int channels,
+        int factor, unsigned char* dst, int dstStride, ResampleWorkspace* workspace) {
+    ResampleWorkspace localWorkspace;
+    if (!workspace) {
+        workspace = &localWorkspace;
+    }
+    int dstWidth = srcWidth / factor;
+    int dstHeight = srcHeight / factor;
+    int rowLength = dstWidth * factor * channels;
+    unsigned int area = factor * factor;
+    std::vector<unsigned short> &sums = workspace->row;
+    sums.resize(rowLength);
+    for (int y = 0; y < dstHeight; y++) {
+        //sum of factor source rows, vectorized
+        memset(&sums[0], 0, rowLength * sizeof(unsigned short));
+        for (int k = 0; k < factor; k++) {
+            addRowKernel(&sums[0], src + (y * factor + k) * srcStride, rowLength);
+        }
+        unsigned char* dstRow = dst + y * dstStride;
+        const unsigned short* column = &sums[0];
+        for (int x = 0; x < dstWidth; x++, column += factor * channels) {
+            for (int c = 0; c < channels; c++) {
+                unsigned int sum = 0;
+                for (int k = 0; k < factor; k++) {
+                    sum += column[k * channels + c];
+                }
+                dstRow[x * channels + c] = (unsigned char)((sum + area / 2) / area);
+            }
+        }
+    }
+}
+
+/**
+    Computes source positions and weights of bilinear filter for one axis, pixel centers are aligned.
+    @param srcSize the int source size.
+    @param dstSize the int destination size.
+    @param index0 output first source index for each destination position.
+    @param index1 output second source index.
+    @param weight output fixed point weight of second source pixel.
+*/
+static void computeAxis(int srcSize, int dstSize, std::vector<int> &index0, std::vector<int> &index1,
+        std::vector<int> &weight) {
+    index0.resize(dstSize);
+    index1.resize(dstSize);
+    weight.resize(dstSize);
+    double scale = (double)srcSize / dstSize;
+    for (int i = 0; i < dstSize; i++) {
+        double pos = (i + 0.5) * scale - 0.5;
+        if (pos < 0) {
+            pos = 0;
+        }
+        int i0 = (int)pos;
+        if (i0 > srcSize - 1) {
+            i0 = srcSize - 1;
+        }
+        int i1 = i0 < srcSize - 1 ? i0 + 1 : i0;
+        int w = (int)((pos - i0) * WEIGHT_ONE + 0.5);
+        index0[i] = i0;
+        index1[i] = i1;
+        weight[i] = w > WEIGHT_ONE ? WEIGHT_ONE : w;
+    }
+}
+
+/**
+    Resizes image with bilinear filter: vertical pass with vectorized row kernel, then horizontal pass.
+    @param src the source pixels.
+    @param srcWidth the int source width.
+    @param srcHeight the int source height.
+    @param srcStride the int size of source row in bytes.
+    @param channels the int count of channels, interleaved.
+    @param dst the destination pixels.
+    @param dstWidth the int destination width.
+    @param dstHeight the int destination height.
+    @param dstStride the int size of destination row in bytes.
+    @param workspace the temporary buffers, can be NULL.
+*/
+void resizeBilinear(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int channels,
+        unsigned char* dst, int dstWidth, int dstHeight, int dstStride, ResampleWorkspace* workspace) {
+    ResampleWorkspace localWorkspace;
+    if (!workspace) {
+        workspace = &localWorkspace;
+    }
+    std::vector<int> &x0 = workspace->x0, &x1 = workspace->x1, &wx = workspace->wx;
+    std::vector<int> &y0 = workspace->y0, &y1 = workspace->y1, &wy = workspace->wy;
+    computeAxis(srcWidth, dstWidth, x0, x1, wx);
+    computeAxis(srcHeight, dstHeight, y0, y1, wy);
+    std::vector<unsigned short> &row = workspace->row;
+    row.resize(srcWidth * channels);
+    for (int y = 0; y < dstHeight; y++) {
+        lerpRowsKernel(&row[0], src + y0[y] * srcStride, src + y1[y] * srcStride, srcWidth * channels,
+            WEIGHT_ONE - wy[y], wy[y]);
+        unsigned char* dstRow = dst + y * dstStride;
+        for (int x = 0; x < dstWidth; x++) {
+            const unsigned short* p0 = &row[x0[x] * channels];
+            const unsigned short* p1 = &row[x1[x] * channels];
+            unsigned int w1 = wx[x];
+            unsigned int w0 = WEIGHT_ONE - w1;
+            for (int c = 0; c < channels; c++) {
+                dstRow[x * channels + c] = (unsigned char)((p0[c] * w0 + p1[c] * w1 + 32768) >> 16);
+            }
+        }
+    }
+}
+
+/**
+    Resizes image. Integer downsample uses box filter; large downsample uses box pre-pass
+    by integer part of factor, so bilinear filter does not skip source pixels.
+    @param src the source pixels.
+    @param srcWidth the int source width.
+    @param srcHeight the int source height.
+    @param srcStride the int size of source row in bytes.
+    @param channels the int count of channels, interleaved.
+    @param dst the destination pixels.
+    @param dstWidth the int destination width.
+    @param dstHeight the int destination height.
+    @param dstStride the int size of destination row in bytes.
+    @param workspace the temporary buffers, can be NULL.
+*/
+void resizeImage(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int channels,
+        unsigned char* dst, int dstWidth, int dstHeight, int dstStride, ResampleWorkspace* workspace) {
+    if (srcWidth == dstWidth && srcHeight == dstHeight) {
+        for (int y = 0; y < dstHeight; y++) {
+            memcpy(dst + y * dstStride, src + y * srcStride, dstWidth * channels);
+        }
+        return;
+    }
+    int factorX = srcWidth / dstWidth;
+    int factorY = srcHeight / dstHeight;
+    int factor = factorX < factorY ? factorX : factorY;
+    if (factor > 257) {
+        factor = 257;
+    }
+    if (factor > 1 && srcWidth == dstWidth * factor && srcHeight == dstHeight * factor) {
+        downsampleBox(src, srcWidth, srcHeight, srcStride, channels, factor, dst, dstStride, workspace);
+        return;
+    }
+    if (factor > 1) {
+        ResampleWorkspace localWorkspace;
+        if (!workspace) {
+            workspace = &localWorkspace;
+        }
+        int boxWidth = srcWidth / factor;
+        int boxHeight = srcHeight / factor;
+        std::vector<unsigned char> &box = workspace->box;
+        box.resize(boxWidth * boxHeight * channels);
+        downsampleBox(src, srcWidth, srcHeight, srcStride, channels, factor, &box[0], boxWidth * channels, workspace);
+        resizeBilinear(&box[0], boxWidth, boxHeight, boxWidth * channels, channels,
+            dst, dstWidth, dstHeight, dstStride, workspace);
+        return;
+    }
+    resizeBilinear(src, srcWidth, srcHeight, srcStride, channels, dst, dstWidth, dstHeight, dstStride, workspace);
+}
+
+/**
+    Mirrors image rows in place, without temporary buffers.
+    @param data the pixels.
+    @param width the int image width.
+    @param height the int image height.
+    @param stride the int size of row in bytes.
+    @param channels the int count of channels, interleaved.
+*/
+void flipHorizontal(unsigned char* data, int width, int height, int stride, int channels) {
+    for (int y = 0; y < height; y++) {
+        unsigned char* left = data + y * stride;
+        unsigned char* right = left + (width - 1) * channels;
+        for (; left < right; left += channels, right -= channels) {
+            std::swap_ranges(left, left + channels, right);
+        }
+    }
+}
+
+/**
+    Reverses order of image rows in place, without temporary buffers.
+    @param data the pixels.
+    @param width the int image width.
+    @param height the int image height.
+    @param stride the int size of row in bytes.
+    @param channels the int count of channels, interleaved.
+*/
+void flipVertical(unsigned char* data, int width, int height, int stride, int channels) {
+    for (int top = 0, bottom = height - 1; top < bottom; top++, bottom--) {
+        unsigned char* topRow = data + top * stride;
+        std::swap_ranges(topRow, topRow + width * channels, data + bottom * stride);
+    }
+}
+
+//Checks whether image can be processed by resampler.
+static bool isSupported(const osg::Image& image) {
+    int channels = osg::Image::computeNumComponents(image.getPixelFormat());
+    return image.getDataType() == GL_UNSIGNED_BYTE && image.r() == 1 && channels >= 1 && channels <= 4
+        && image.s() > 0 && image.t() > 0;
+}
+
+/**
+    Resamples image into preallocated destination image, destination size defines the scale.
+    @param src the source image.
+    @param dst the destination image, 8-bit with the same pixel format as source.
+    @param workspace the temporary buffers, can be NULL.
+    @return true on success, false if images are not supported
+*/
+bool resampleImage(const osg::Image& src, osg::Image& dst, ResampleWorkspace* workspace) {
+    if (!isSupported(src) || !isSupported(dst) || src.getPixelFormat() != dst.getPixelFormat()) {
+        return false;
+    }
+    resizeImage(src.data(), src.s(), src.t(), src.getRowStepInBytes(),
+        osg::Image::computeNumComponents(src.getPixelFormat()),
+        dst.data(), dst.s(), dst.t(), dst.getRowStepInBytes(), workspace);
+    return true;
+}
+
+/**
+    Scales image in place to specified size.
+    @param image the image.
+    @param width the int new width.
+    @param height the int new height.
+*/
+void scaleImage(osg::Image& image, int width, int height) {
+    if (!isSupported(image) || width <= 0 || height <= 0) {
+        image.scaleImage(width, height, image.r());
+        return;
+    }
+    if (image.s() == width && image.t() == height) {
+        return;
+    }
+    int channels = osg::Image::computeNumComponents(image.getPixelFormat());
+    unsigned char* data = new unsigned char[width * height * channels];
+    resizeImage(image.data(), image.s(), image.t(), image.getRowStepInBytes(), channels,
+        data, width, height, width * channels);
+    image.setImage(width, height, 1, image.getInternalTextureFormat(), image.getPixelFormat(),
+        GL_UNSIGNED_BYTE, data, osg::Image::USE_NEW_DELETE, 1);
+}
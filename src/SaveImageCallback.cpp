@@ -1,10 +1,21 @@
-#include <osgDB/WriteFile>
+#include <osg/BufferObject>
+#include <osg/Timer>
+#include <OpenThreads/ScopedLock>
 #include "SaveImageCallback.h"
+#include "Profiler.h"
+
+#include <string.h>
 
 //constructor
 SaveImageCallback::SaveImageCallback(int _outputWidth) {
     outputWidth = _outputWidth;
+    pboCount = 0;
+    maskFormat = MASK_IMAGE;
+    imageWriter = new ImageWriter(outputWidth, 0, 0);
     finished = true;
+    currentPbo = 0;
+    pboWidth = 0;
+    pboHeight = 0;
 }
 
 //destructor
@@ -12,12 +23,36 @@ SaveImageCallback::~SaveImageCallback() {
 
 }
 
+/**
+    Overrided operator (), dispatches to synchronous or PBO-based asynchronous readback.
+    @param renderInfo osg RenderInfo of the camera being drawn.
+*/
+void SaveImageCallback::operator () (osg::RenderInfo& renderInfo) const {
+    if (idImage.valid()) {
+        saveObjectIdFrame();
+        return;
+    }
+    if (pboCount > 1) {
+        osg::GLExtensions* ext = osg::GLExtensions::Get(renderInfo.getContextID(), true);
+        if (ext && ext->isPBOSupported) {
+            readPixelsAsync(renderInfo);
+            return;
+        }
+    }
+    if (renderInfo.getCurrentCamera()) {
+        operator()(*renderInfo.getCurrentCamera());
+    }
+}
+
 /**
     Overrided operator (), saves generated image to a file
     @param bg_cam osg Camera.
 */
 void SaveImageCallback::operator () (const osg::Camera& camera) const {
-    finished = false;
+    if (fileName.empty()) {
+        signalFinished();
+        return;
+    }
     int x,y,width,height;
     x = camera.getViewport()->x();
     y = camera.getViewport()->y();
@@ -25,14 +60,318 @@ void SaveImageCallback::operator () (const osg::Camera& camera) const {
     height = camera.getViewport()->height();
 
     osg::ref_ptr<osg::Image> image = new osg::Image;
-    image->readPixels(x,y,width,height,GL_RGB,GL_UNSIGNED_BYTE);
-    int w = width - x;
-    int h = height - y;
-    int t = outputWidth * h / w;
-    image->scaleImage(outputWidth, t, 1);
+    {
+        StageTimer timer(Profiler::READBACK);
+        image->readPixels(x,y,width,height,GL_RGB,GL_UNSIGNED_BYTE);
+    }
+    saveImage(image.get(), fileName);
+    signalFinished();
+}
+
+/**
+    Starts reading current frame into the next pixel buffer object of the ring,
+    then maps the oldest buffer and saves the frame stored in it.
+    With empty file name no new frame is read and all pending frames are saved.
+    @param renderInfo osg RenderInfo of the camera being drawn.
+*/
+void SaveImageCallback::readPixelsAsync(osg::RenderInfo& renderInfo) const {
+    const osg::Viewport* viewport = renderInfo.getCurrentCamera()->getViewport();
+    int x = viewport->x();
+    int y = viewport->y();
+    int width = viewport->width();
+    int height = viewport->height();
+    osg::GLExtensions* ext = osg::GLExtensions::Get(renderInfo.getContextID(), true);
+
+    if (pbos.empty() || width != pboWidth || height != pboHeight) {
+        //ring is (re)allocated, frames pending in old buffers are saved first
+        for (int i = 0; i < pbos.size(); i++) {
+            mapPixelBuffer(ext, (currentPbo + i) % pbos.size());
+        }
+        if (!pbos.empty()) {
+            ext->glDeleteBuffers(pbos.size(), &pbos[0]);
+        }
+        pbos.assign(pboCount, 0);
+        pendingNames.assign(pboCount, std::string());
+        ext->glGenBuffers(pboCount, &pbos[0]);
+        for (int i = 0; i < pboCount; i++) {
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbos[i]);
+            ext->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, width * height * 3, 0, GL_STREAM_READ);
+        }
+        currentPbo = 0;
+        pboWidth = width;
+        pboHeight = height;
+    }
+
+    if (!fileName.empty()) {
+        {
+            StageTimer timer(Profiler::READBACK);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbos[currentPbo]);
+            glReadPixels(x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        }
+        pendingNames[currentPbo] = fileName;
+        currentPbo = (currentPbo + 1) % pbos.size();
+        //the next buffer holds the oldest frame
+        mapPixelBuffer(ext, currentPbo);
+    }
+    else {
+        for (int i = 0; i < pbos.size(); i++) {
+            mapPixelBuffer(ext, (currentPbo + i) % pbos.size());
+        }
+    }
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    signalFinished();
+}
+
+/**
+    Maps specified pixel buffer object and saves the frame pending in it, if any.
+    @param ext GL extensions of current context.
+    @param slot index of buffer in the ring.
+*/
+void SaveImageCallback::mapPixelBuffer(osg::GLExtensions* ext, int slot) const {
+    if (pendingNames[slot].empty()) {
+        return;
+    }
+    osg::ref_ptr<osg::Image> image;
+    {
+        //mapping waits for transfer of frame, if it is not finished yet
+        StageTimer timer(Profiler::READBACK);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbos[slot]);
+        GLubyte* src = (GLubyte*)ext->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+        if (src) {
+            image = new osg::Image;
+            image->allocateImage(pboWidth, pboHeight, 1, GL_RGB, GL_UNSIGNED_BYTE, 1);
+            memcpy(image->data(), src, image->getTotalSizeInBytes());
+            ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+        }
+    }
+    if (image.valid()) {
+        saveImage(image.get(), pendingNames[slot]);
+    }
+    pendingNames[slot].clear();
+}
+
+/**
+    Passes image to ImageWriter, the image should not be used by callback later.
+    @param image the image read back from frame buffer.
+    @param name file name to save image.
+*/
+void SaveImageCallback::saveImage(osg::Image* image, const std::string& name) const {
+    imageWriter->write(image, name);
+}
+
+/**
+    Requests mask to be derived from object ID image of the next frame.
+    @param maskFileName file name to save mask.
+    @param objectBits bit set of 1-based object IDs painted in mask, bit 0 corresponds to ID 1.
+*/
+void SaveImageCallback::addMaskRequest(const std::string& maskFileName, unsigned int objectBits) {
+    MaskRequest request;
+    request.fileName = maskFileName;
+    request.objectBits = objectBits;
+    maskRequests.push_back(request);
+}
+
+/**
+    Saves colour image and requested masks of frame rendered into object ID render targets.
+    Images attached to camera are already read back by osg, so they are copied before passing to writer.
+*/
+void SaveImageCallback::saveObjectIdFrame() const {
+    if (!fileName.empty()) {
+        saveImage(new osg::Image(*colorImage, osg::CopyOp::DEEP_COPY_ALL), fileName);
+    }
+    std::vector<std::string> encoded;
+    for (int i = 0; i < maskRequests.size(); i++) {
+        if (maskFormat == MASK_RLE) {
+            encoded.push_back(encodeMask(maskRequests[i].objectBits));
+        }
+        else if (maskFormat == MASK_GRAY) {
+            saveImage(createGrayMask(maskRequests[i].objectBits), maskRequests[i].fileName);
+        }
+        else {
+            saveImage(createMask(maskRequests[i].objectBits), maskRequests[i].fileName);
+        }
+    }
+    maskRequests.clear();
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(finishedMutex);
+        encodedMasks.swap(encoded);
+    }
+    signalFinished();
+}
+
+/**
+    Returns run-length encoded masks of last processed frame, should be called after frame is finished.
+    @return masks in order of requests
+*/
+std::vector<std::string> SaveImageCallback::takeEncodedMasks() {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(finishedMutex);
+    std::vector<std::string> masks;
+    masks.swap(encodedMasks);
+    return masks;
+}
+
+/**
+    Creates mask image from object ID image: pixels of requested objects are black,
+    other pixels are taken from mask background (white if background is not set or has other size).
+    @param objectBits bit set of 1-based object IDs painted in mask.
+    @return a new RGB mask image.
+*/
+osg::Image* SaveImageCallback::createMask(unsigned int objectBits) const {
+    int width = idImage->s();
+    int height = idImage->t();
+    int idStep = osg::Image::computeNumComponents(idImage->getPixelFormat());
+    osg::Image* mask = new osg::Image;
+    mask->allocateImage(width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, 1);
+    int bgStep = 0;
+    if (maskBackground.valid() && maskBackground->s() == width && maskBackground->t() == height
+            && maskBackground->getDataType() == GL_UNSIGNED_BYTE) {
+        bgStep = osg::Image::computeNumComponents(maskBackground->getPixelFormat());
+    }
+    for (int row = 0; row < height; row++) {
+        const unsigned char* ids = idImage->data(0, row);
+        const unsigned char* bg = bgStep >= 3 ? maskBackground->data(0, row) : NULL;
+        unsigned char* dst = mask->data(0, row);
+        for (int col = 0; col < width; col++, dst += 3) {
+            int id = ids[col * idStep];
+            if (id > 0 && id <= MAX_MASK_OBJECTS && (objectBits & (1u << (id - 1)))) {
+                dst[0] = dst[1] = dst[2] = 0;
+            }
+            else if (bg) {
+                dst[0] = bg[col * bgStep];
+                dst[1] = bg[col * bgStep + 1];
+                dst[2] = bg[col * bgStep + 2];
+            }
+            else {
+                dst[0] = dst[1] = dst[2] = 255;
+            }
+        }
+    }
+    return mask;
+}
+
+/**
+    Creates single-channel mask image at output size: pixels of requested objects are 255,
+    other pixels are 0, mask background is not used. Object ID image is sampled at centres of output
+    pixels like in encodeMask, so mask stays binary and writer does not scale it.
+    @param objectBits bit set of 1-based object IDs painted in mask.
+    @return a new luminance mask image.
+*/
+osg::Image* SaveImageCallback::createGrayMask(unsigned int objectBits) const {
+    int width = idImage->s();
+    int height = idImage->t();
+    int idStep = osg::Image::computeNumComponents(idImage->getPixelFormat());
+    int outWidth = outputWidth > 0 ? outputWidth : width;
+    int outHeight = outWidth * height / width;
+    osg::Image* mask = new osg::Image;
+    mask->allocateImage(outWidth, outHeight, 1, GL_LUMINANCE, GL_UNSIGNED_BYTE, 1);
+    for (int row = 0; row < outHeight; row++) {
+        //rows are counted from top as in encodeMask, osg image rows start at bottom
+        const unsigned char* ids = idImage->data(0, height - 1 - (2 * row + 1) * height / (2 * outHeight));
+        unsigned char* dst = mask->data(0, outHeight - 1 - row);
+        for (int col = 0; col < outWidth; col++) {
+            int id = ids[(2 * col + 1) * width / (2 * outWidth) * idStep];
+            dst[col] = id > 0 && id <= MAX_MASK_OBJECTS && (objectBits & (1u << (id - 1))) ? 255 : 0;
+        }
+    }
+    return mask;
+}
 
-    if (osgDB::writeImageFile(*image, fileName)) {
-        std::cout << "Saved screen image to `"<<fileName<<"`"<< std::endl;
+/**
+    Encodes mask of requested objects at output size as COCO compressed RLE string: runs of
+    alternating background and object pixels in column-major order from top left corner,
+    starting with background. Object ID image is sampled at centres of output pixels.
+    @param objectBits bit set of 1-based object IDs painted in mask.
+    @return counts string, as used by pycocotools with size [height, width] of output image
+*/
+std::string SaveImageCallback::encodeMask(unsigned int objectBits) const {
+    int width = idImage->s();
+    int height = idImage->t();
+    int idStep = osg::Image::computeNumComponents(idImage->getPixelFormat());
+    int outWidth = outputWidth > 0 ? outputWidth : width;
+    int outHeight = outWidth * height / width;
+    std::vector<long> counts;
+    long run = 0;
+    bool object = false;
+    for (int col = 0; col < outWidth; col++) {
+        int srcCol = (2 * col + 1) * width / (2 * outWidth);
+        for (int row = 0; row < outHeight; row++) {
+            //osg image rows start at bottom
+            int srcRow = height - 1 - (2 * row + 1) * height / (2 * outHeight);
+            int id = idImage->data(0, srcRow)[srcCol * idStep];
+            bool painted = id > 0 && id <= MAX_MASK_OBJECTS && (objectBits & (1u << (id - 1)));
+            if (painted != object) {
+                counts.push_back(run);
+                run = 0;
+                object = painted;
+            }
+            run++;
+        }
+    }
+    counts.push_back(run);
+    //counts are stored as differences to count two runs before, 5 bits per char
+    std::string result;
+    for (int i = 0; i < counts.size(); i++) {
+        long x = counts[i];
+        if (i > 2) {
+            x -= counts[i - 2];
+        }
+        bool more = true;
+        while (more) {
+            char c = x & 0x1f;
+            x >>= 5;
+            more = (c & 0x10) ? x != -1 : x != 0;
+            if (more) {
+                c |= 0x20;
+            }
+            result += (char)(c + 48);
+        }
     }
+    return result;
+}
+
+/**
+    Checks whether processing of the current frame is finished.
+    @return true if finished
+*/
+bool SaveImageCallback::isFinished() {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(finishedMutex);
+    return finished;
+}
+
+/**
+    Sets finished flag, should be reset to false before each frame.
+    @param _finished the flag value.
+*/
+void SaveImageCallback::setFinished(bool _finished) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(finishedMutex);
+    finished = _finished;
+    if (finished) {
+        finishedCondition.broadcast();
+    }
+}
+
+//Marks current frame as processed and wakes up waiting threads.
+void SaveImageCallback::signalFinished() const {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(finishedMutex);
     finished = true;
+    finishedCondition.broadcast();
+}
+
+/**
+    Blocks until processing of the current frame is finished.
+    @param timeoutMs the maximal waiting time in milliseconds.
+    @return true if frame is processed, false on timeout
+*/
+bool SaveImageCallback::waitFinished(unsigned long timeoutMs) {
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(finishedMutex);
+    while (!finished) {
+        double elapsed = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+        if (elapsed >= timeoutMs) {
+            return false;
+        }
+        finishedCondition.wait(&finishedMutex, timeoutMs - (unsigned long)elapsed);
+    }
+    return true;
 }
@@ -0,0 +1,128 @@
+#include "Shaders.h"
+
+#include <osg/Shader>
+#include <osg/Image>
+
+#include <sstream>
+
+//fixed function like lighting of light 0, shared by model programs
+static const char* lightingSource =
+    "vec4 lightColor(vec3 normal, vec4 ecPosition) {\n"
+    "    vec3 lightDir;\n"
+    "    if (gl_LightSource[0].position.w == 0.0) {\n"
+    "        lightDir = normalize(gl_LightSource[0].position.xyz);\n"
+    "    }\n"
+    "    else {\n"
+    "        lightDir = normalize(gl_LightSource[0].position.xyz - ecPosition.xyz);\n"
+    "    }\n"
+    "    float nDotL = max(dot(normal, lightDir), 0.0);\n"
+    "    vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+    "        + gl_FrontLightProduct[0].diffuse * nDotL;\n"
+    "    if (nDotL > 0.0) {\n"
+    "        vec3 halfVector = normalize(lightDir + normalize(-ecPosition.xyz));\n"
+    "        color += gl_FrontLightProduct[0].specular\n"
+    "            * pow(max(dot(normal, halfVector), 0.0), gl_FrontMaterial.shininess);\n"
+    "    }\n"
+    "    return vec4(clamp(color.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);\n"
+    "}\n";
+
+static const char* objectIdVertexSource =
+    "void main() {\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * gl_Normal);\n"
+    "    gl_FrontColor = lightColor(normal, gl_ModelViewMatrix * gl_Vertex);\n"
+    "    gl_TexCoord[0] = gl_TextureMatrix[0] * gl_MultiTexCoord0;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+//per-instance model matrix is applied before model view matrix, normals are renormalized after it
+static const char* instancedVertexSource =
+    "varying float instanceId;\n"
+    "void main() {\n"
+    "    mat4 instance = instanceMatrices[gl_InstanceIDARB];\n"
+    "    vec4 vertex = instance * gl_Vertex;\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * (mat3(instance) * gl_Normal));\n"
+    "    gl_FrontColor = lightColor(normal, gl_ModelViewMatrix * vertex);\n"
+    "    gl_TexCoord[0] = gl_TextureMatrix[0] * gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vertex;\n"
+    "    instanceId = float(gl_InstanceIDARB + 1);\n"
+    "}\n";
+
+static const char* instancedFragmentSource =
+    "#version 120\n"
+    "uniform sampler2D baseTexture;\n"
+    "void main() {\n"
+    "    gl_FragColor = gl_Color * texture2D(baseTexture, gl_TexCoord[0].st);\n"
+    "}\n";
+
+static const char* instancedIdFragmentSource =
+    "#version 120\n"
+    "uniform sampler2D baseTexture;\n"
+    "varying float instanceId;\n"
+    "void main() {\n"
+    "    gl_FragData[0] = gl_Color * texture2D(baseTexture, gl_TexCoord[0].st);\n"
+    "    gl_FragData[1] = vec4(instanceId / 255.0, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* objectIdFragmentSource =
+    "#version 120\n"
+    "uniform sampler2D baseTexture;\n"
+    "uniform float objectId;\n"
+    "void main() {\n"
+    "    gl_FragData[0] = gl_Color * texture2D(baseTexture, gl_TexCoord[0].st);\n"
+    "    gl_FragData[1] = vec4(objectId, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* backgroundIdFragmentSource =
+    "#version 120\n"
+    "#extension GL_ARB_texture_rectangle : enable\n"
+    "uniform sampler2DRect backgroundTexture;\n"
+    "void main() {\n"
+    "    gl_FragData[0] = texture2DRect(backgroundTexture, gl_TexCoord[0].st);\n"
+    "    gl_FragData[1] = vec4(0.0, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+osg::Program* createObjectIdProgram() {
+    osg::Program* program = new osg::Program;
+    program->setName("objectId");
+    program->addShader(new osg::Shader(osg::Shader::VERTEX,
+        std::string("#version 120\n") + lightingSource + objectIdVertexSource));
+    program->addShader(new osg::Shader(osg::Shader::FRAGMENT, objectIdFragmentSource));
+    return program;
+}
+
+osg::Program* createInstancedProgram(int instanceCount, bool objectIds) {
+    std::ostringstream vertexSource;
+    vertexSource << "#version 120\n"
+        << "#extension GL_ARB_draw_instanced : require\n"
+        << "uniform mat4 instanceMatrices[" << instanceCount << "];\n"
+        << lightingSource << instancedVertexSource;
+    osg::Program* program = new osg::Program;
+    program->setName(objectIds ? "instancedId" : "instanced");
+    program->addShader(new osg::Shader(osg::Shader::VERTEX, vertexSource.str()));
+    program->addShader(new osg::Shader(osg::Shader::FRAGMENT,
+        objectIds ? instancedIdFragmentSource : instancedFragmentSource));
+    return program;
+}
+
+osg::Program* createBackgroundIdProgram() {
+    osg::Program* program = new osg::Program;
+    program->setName("backgroundId");
+    program->addShader(new osg::Shader(osg::Shader::FRAGMENT, backgroundIdFragmentSource));
+    return program;
+}
+
+osg::Texture2D* createWhiteTexture() {
+    osg::Image* image = new osg::Image;
+    image->allocateImage(1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    unsigned char* data = image->data();
+    data[0] = data[1] = data[2] = data[3] = 255;
+    osg::Texture2D* texture = new osg::Texture2D(image);
+    texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    return texture;
+}
+
+float objectIdToUniform(int id) {
+    //stored in 8-bit normalized channel, read back as integer id
+    return (float)id / 255.0f;
+}
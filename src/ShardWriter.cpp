@@ -0,0 +1,168 @@
+#include "ShardWriter.h"
+
+#include <osg/Notify>
+#include <OpenThreads/ScopedLock>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+//size of tar header and data blocks
+static const int BLOCK_SIZE = 512;
+
+/**
+    Constructor, shards and index are opened when first member is appended.
+    @param _prefix path prefix of shard and index files.
+    @param _root path prefix removed from member names, e.g. output folder.
+    @param _shardSize the max size of shard in bytes, a single larger member takes whole shard.
+    @param resume continue index of previous run.
+*/
+ShardWriter::ShardWriter(const std::string &_prefix, const std::string &_root, long long _shardSize, bool _resume)
+    : prefix(_prefix), root(_root), shardSize(_shardSize), resume(_resume) {
+    shardIndex = 0;
+    shard = NULL;
+    shardBytes = 0;
+    index = NULL;
+}
+
+//destructor, ends current shard
+ShardWriter::~ShardWriter() {
+    closeShard();
+    if (index) {
+        fclose(index);
+    }
+}
+
+//Returns file name of shard with specified sequence number.
+std::string ShardWriter::shardName(int index) {
+    char number[16];
+    snprintf(number, sizeof(number), "%06d", index);
+    return prefix + "-" + number + ".tar";
+}
+
+//Returns member name of file, relative to root if file is inside it, absolute paths are made relative.
+std::string ShardWriter::memberName(const std::string &fileName) {
+    if (!root.empty() && fileName.compare(0, root.size() + 1, root + "/") == 0) {
+        return fileName.substr(root.size() + 1);
+    }
+    size_t start = fileName.find_first_not_of('/');
+    return start == std::string::npos ? fileName : fileName.substr(start);
+}
+
+//Opens next shard, index is opened with first shard.
+bool ShardWriter::openShard() {
+    if (!index) {
+        if (resume) {
+            struct stat sb;
+            while (stat(shardName(shardIndex).c_str(), &sb) == 0) {
+                shardIndex++;
+            }
+        }
+        std::string indexFile = prefix + ".idx";
+        index = fopen(indexFile.c_str(), resume ? "ab" : "wb");
+        if (!index) {
+            osg::notify(osg::WARN) << "Shard index '" << indexFile << "' can not be written" << std::endl;
+            return false;
+        }
+    }
+    shardFile = shardName(shardIndex++);
+    shard = fopen(shardFile.c_str(), "wb");
+    shardBytes = 0;
+    if (!shard) {
+        osg::notify(osg::WARN) << "Shard '" << shardFile << "' can not be written" << std::endl;
+    }
+    return shard != NULL;
+}
+
+//Ends archive of current shard by two zero blocks and closes it.
+void ShardWriter::closeShard() {
+    if (!shard) {
+        return;
+    }
+    std::vector<char> end(2 * BLOCK_SIZE, 0);
+    fwrite(&end[0], 1, end.size(), shard);
+    fclose(shard);
+    shard = NULL;
+}
+
+/**
+    Appends file to current shard as tar member and records it in index.
+    @param fileName path of file as it would be saved, member name is relative to root.
+    @param data the file content.
+    @return false if member can not be written
+*/
+bool ShardWriter::append(const std::string &fileName, const std::string &data) {
+    std::string name = memberName(fileName);
+    if (name.size() >= 100) {
+        osg::notify(osg::WARN) << "Member name '" << name << "' is too long for shard" << std::endl;
+        return false;
+    }
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mutex);
+    long long memberSize = BLOCK_SIZE + (data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    if (shard && shardBytes > 0 && shardBytes + memberSize > shardSize) {
+        closeShard();
+    }
+    if (!shard && !openShard()) {
+        return false;
+    }
+    //ustar header, numbers are octal text
+    char header[BLOCK_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, name.data(), name.size());
+    snprintf(header + 100, 8, "%07o", 0644);
+    snprintf(header + 108, 8, "%07o", 0);
+    snprintf(header + 116, 8, "%07o", 0);
+    snprintf(header + 124, 12, "%011llo", (unsigned long long)data.size());
+    snprintf(header + 136, 12, "%011llo", (unsigned long long)time(0));
+    header[156] = '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    //checksum is computed with its own field filled by spaces
+    memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        checksum += (unsigned char)header[i];
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+
+    long long offset = shardBytes + BLOCK_SIZE;
+    char padding[BLOCK_SIZE];
+    memset(padding, 0, sizeof(padding));
+    size_t paddingSize = memberSize - BLOCK_SIZE - data.size();
+    bool written = fwrite(header, 1, BLOCK_SIZE, shard) == BLOCK_SIZE
+        && fwrite(data.data(), 1, data.size(), shard) == data.size()
+        && fwrite(padding, 1, paddingSize, shard) == paddingSize;
+    shardBytes += memberSize;
+    if (!written) {
+        osg::notify(osg::WARN) << "Member '" << name << "' can not be written to '" << shardFile << "'" << std::endl;
+        return false;
+    }
+    if (index) {
+        const char* shardShortName = strrchr(shardFile.c_str(), '/');
+        fprintf(index, "%s %s %lld %lu\n", name.c_str(), shardShortName ? shardShortName + 1 : shardFile.c_str(),
+            offset, (unsigned long)data.size());
+    }
+    return true;
+}
+
+/**
+    Writes appended members and index to disk.
+    @return false if files can not be written
+*/
+bool ShardWriter::flush() {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mutex);
+    bool written = true;
+    if (shard) {
+        written = fflush(shard) == 0;
+        fsync(fileno(shard));
+    }
+    if (index) {
+        written = fflush(index) == 0 && written;
+        fsync(fileno(index));
+    }
+    return written;
+}
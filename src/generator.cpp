@@ -1,5 +1,7 @@
 #include "ImgGenerator.h"
 
+#include <stdio.h>
+
 
 //main entry
 int main(int argc, char ** argv) {
@@ -11,9 +13,27 @@ int main(int argc, char ** argv) {
         cfgPath = "./config.json";
     }
     Configurator cfg;
-    cfg.parse(cfgPath);
+    if (cfg.parse(cfgPath) != 0) {
+        return 1;
+    }
     int mode = 0;
     arguments.read("-mode", mode);
+    //-shard i/N generates i-th of N ranges of images, -merge N joins labels of N shards
+    std::string shard;
+    int shardIndex = 0;
+    int shardCount = 1;
+    if (arguments.read("-shard", shard)) {
+        if (sscanf(shard.c_str(), "%d/%d", &shardIndex, &shardCount) != 2
+                || shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount) {
+            osg::notify(osg::FATAL)<<"Invalid shard '"<<shard<<"', expected i/N with 0 <= i < N"<<std::endl;
+            return 1;
+        }
+    }
+    int mergeCount = 0;
+    if (arguments.read("-merge", mergeCount)) {
+        ImgGenerator generator(cfg);
+        return generator.mergeLabels(mergeCount);
+    }
     if (mode == 2) { //debug mode, configuration check
         std::vector<Translation> tList = cfg.getTranslations();
         osg::notify(osg::NOTICE)<<"Translations "<<tList.size()<<std::endl;
@@ -26,6 +46,9 @@ int main(int argc, char ** argv) {
     else {
         ImgGenerator* generator = new ImgGenerator(cfg);
         generator->setMode(mode);
+        generator->setShard(shardIndex, shardCount);
+        //-resume continues generation after images committed to manifest
+        generator->setResume(arguments.read("-resume"));
         if (mode == 4) {
             generator->generateMultipleImages();
         }
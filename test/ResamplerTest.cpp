@@ -0,0 +1,127 @@
+#include "Resampler.h"
+
+#include <osg/Image>
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+
+/**
+    Compares resampler kernels with osg::Image::scaleImage. Every kernel supported by CPU must give
+    the same pixels as scalar kernel, and pixels close to osg result within tolerance: filters differ
+    slightly, so smooth test images are used, where the difference is limited by image gradient.
+*/
+
+//max and mean absolute difference of pixels to osg result
+static const int MAX_DIFFERENCE = 8;
+static const double MEAN_DIFFERENCE = 2.0;
+
+struct TestCase {
+    int srcWidth, srcHeight, dstWidth, dstHeight, channels;
+};
+
+//Returns 8-bit pixel format of channels count.
+static GLenum pixelFormat(int channels) {
+    switch (channels) {
+        case 1: return GL_LUMINANCE;
+        case 2: return GL_LUMINANCE_ALPHA;
+        case 3: return GL_RGB;
+    }
+    return GL_RGBA;
+}
+
+/**
+    Creates image with smooth pattern, channels have different phase.
+    @param test the test case of source size and channels.
+    @return a new image
+*/
+static osg::Image* createImage(const TestCase &test) {
+    osg::Image* image = new osg::Image;
+    image->allocateImage(test.srcWidth, test.srcHeight, 1, pixelFormat(test.channels), GL_UNSIGNED_BYTE, 1);
+    for (int y = 0; y < test.srcHeight; y++) {
+        unsigned char* row = image->data(0, y);
+        for (int x = 0; x < test.srcWidth; x++) {
+            for (int c = 0; c < test.channels; c++) {
+                double v = 128 + 100 * sin(x * 0.02 + c) * cos(y * 0.015 - c);
+                row[x * test.channels + c] = (unsigned char)(v + 0.5);
+            }
+        }
+    }
+    return image;
+}
+
+/**
+    Resamples source image with every kernel and compares results.
+    @param test the test case.
+    @return count of failed kernels
+*/
+static int runTest(const TestCase &test) {
+    osg::ref_ptr<osg::Image> src = createImage(test);
+    osg::ref_ptr<osg::Image> reference = new osg::Image(*src, osg::CopyOp::DEEP_COPY_ALL);
+    reference->scaleImage(test.dstWidth, test.dstHeight, 1);
+    int stride = test.dstWidth * test.channels;
+    int size = stride * test.dstHeight;
+    std::vector<unsigned char> scalar(size);
+    setResampleKernel(RESAMPLE_SCALAR);
+    resizeImage(src->data(), test.srcWidth, test.srcHeight, src->getRowStepInBytes(), test.channels,
+        &scalar[0], test.dstWidth, test.dstHeight, stride);
+
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    const int kernels[] = { RESAMPLE_SCALAR, RESAMPLE_SSE2, RESAMPLE_AVX2 };
+    int failed = 0;
+    for (int k = 0; k < 3; k++) {
+        std::cout << test.srcWidth << "x" << test.srcHeight << " -> " << test.dstWidth << "x" << test.dstHeight
+            << ", " << test.channels << " channels, " << names[k] << ": ";
+        if (!setResampleKernel(kernels[k])) {
+            std::cout << "not supported by CPU" << std::endl;
+            continue;
+        }
+        std::vector<unsigned char> dst(size);
+        resizeImage(src->data(), test.srcWidth, test.srcHeight, src->getRowStepInBytes(), test.channels,
+            &dst[0], test.dstWidth, test.dstHeight, stride);
+        int maxDiff = 0;
+        long sumDiff = 0;
+        bool sameAsScalar = true;
+        for (int y = 0; y < test.dstHeight; y++) {
+            const unsigned char* ref = reference->data(0, y);
+            for (int i = 0; i < stride; i++) {
+                int d = abs(dst[y * stride + i] - ref[i]);
+                maxDiff = d > maxDiff ? d : maxDiff;
+                sumDiff += d;
+                sameAsScalar = sameAsScalar && dst[y * stride + i] == scalar[y * stride + i];
+            }
+        }
+        double meanDiff = (double)sumDiff / size;
+        bool ok = sameAsScalar && maxDiff <= MAX_DIFFERENCE && meanDiff <= MEAN_DIFFERENCE;
+        std::cout << (ok ? "ok" : "FAILED") << ", max difference " << maxDiff << ", mean difference " << meanDiff
+            << (sameAsScalar ? "" : ", differs from scalar kernel") << std::endl;
+        if (!ok) {
+            failed++;
+        }
+    }
+    setResampleKernel(RESAMPLE_AUTO);
+    return failed;
+}
+
+int main() {
+    //integer factors use box filter, others box pre-pass and bilinear filter, odd widths test row tails
+    const TestCase tests[] = {
+        { 1600, 1200, 800, 600, 3 },
+        { 2400, 1800, 800, 600, 4 },
+        { 800, 600, 640, 480, 3 },
+        { 1000, 750, 640, 480, 4 },
+        { 803, 601, 517, 386, 1 },
+        { 1203, 901, 401, 300, 2 },
+        { 640, 480, 800, 600, 3 }
+    };
+    int failed = 0;
+    for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        failed += runTest(tests[i]);
+    }
+    if (failed > 0) {
+        std::cout << failed << " kernel comparisons failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}